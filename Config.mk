@@ -0,0 +1,45 @@
+################ Build options #######################################
+
+NAME		:= cwiclo
+MAJOR		:= 
+MINOR		:= 
+
+#DEBUG		:= 1
+
+################ Programs ############################################
+
+CXX		:= g++
+CC		:= gcc
+AR		:= ar
+RANLIB		:= ranlib
+INSTALL		:= install
+
+INSTALLEXE	:= ${INSTALL} -D -p -m 700 -s
+INSTALLDATA	:= ${INSTALL} -D -p -m 644
+INSTALLLIB	:= ${INSTALLDATA}
+RMPATH		:= rmdir -p --ignore-fail-on-non-empty
+
+################ Destination #########################################
+
+prefix		:= /usr/local
+BINDIR		:= ${prefix}/bin
+INCDIR		:= ${prefix}/include
+LIBDIR		:= ${prefix}/lib
+DOCDIR		:= ${prefix}/share/doc
+PKGCONFIGDIR	:= /usr/lib/pkgconfig
+
+################ Compiler options ####################################
+
+CXXFLAGS	:= -Wall -Wextra -Wredundant-decls -Wshadow \
+		-std=c++17 -fno-exceptions -fno-rtti \
+		-ffunction-sections -fdata-sections \
+		-fno-threadsafe-statics -fno-stack-protector
+ifdef DEBUG
+    CXXFLAGS	+= -O0 -ggdb3
+    LDFLAGS	+= -g -rdynamic -no-pie
+else
+    CXXFLAGS	+= -Os -g0 -DNDEBUG=1
+    LDFLAGS	+= -s -no-pie -Wl,-O1,-gc-sections
+endif
+BUILDDIR	:= /tmp//make/${NAME}
+O		:= .o/
@@ -223,6 +223,10 @@ void App::DeleteMsger (mrid_t mid) noexcept
 	    FreeMrid (mid);
     }
 
+    // Its requests can no longer time out
+    if (!_requests.empty())
+	remove_if (_requests, [&](const auto& r) { return r.caller == mid; });
+
     // Notify connected Msgers of this one's destruction
     for (mrid_t i = 0; i < _creators.size(); ++i)
 	if (_creators[i] == mid)
@@ -255,20 +259,48 @@ void App::SwapQueues (void) noexcept
     _inq.swap (move(_outq));	// output queue now becomes the input queue
 }
 
+void App::Prioritize (const Msg::Link& l [[maybe_unused]], Msg::Priority p) noexcept
+{
+    assert (!_outq.empty() && _outq.back().Src() == l.src && _outq.back().Dest() == l.dest
+	    && "a message must be prioritized right after sending it");
+    _outq.back().SetPriority (p);
+    QueueByPriority();
+}
+
+// Moves the last queued message ahead of those of lower priority,
+// but not ahead of any on the same link, to keep the link ordered.
+void App::QueueByPriority (void) noexcept
+{
+    auto n = _outq.size()-1, i = n;
+    auto p = _outq[n].GetPriority();
+    auto l = _outq[n].GetLink();
+    while (i && _outq[i-1].GetPriority() < p
+	    && (_outq[i-1].Src() != l.src || _outq[i-1].Dest() != l.dest))
+	--i;
+    if (i == n)
+	return;
+    Msg msg (move (_outq.back()));
+    _outq.pop_back();
+    _outq.emplace (_outq.iat(i), move (msg));
+}
+
 void App::ProcessInputQueue (void) noexcept
 {
     for (auto& msg : _inq) {
 	// Dump the message if tracing
 	if (DEBUG_MSG_TRACE) {
 	    DEBUG_PRINTF ("Msg: %hu -> %hu.%s.%s [%u] = {""{{\n", msg.Src(), msg.Dest(), msg.Interface(), msg.Method(), msg.Size());
-	    auto msgbody = msg.Read();
-	    hexdump (msgbody.ptr<char>(), msgbody.remaining());
+	    hexdump (msg.GetBody().data(), msg.GetBody().size());
+	    for (auto& s : msg.Segments())
+		hexdump (s.data(), s.size());
 	    DEBUG_PRINTF ("}""}}\n");
 	}
 
 	// Create the dispatch range. Broadcast messages go to all, the rest go to one.
 	auto mg = 0u, mgend = _msgers.size();
 	if (msg.Dest() != mrid_Broadcast) {
+	    if (msg.RequestId() != Msg::NoRequest && !_requests.empty())
+		CompleteRequest (msg);
 	    if (!ValidMsgerId (msg.Dest())) {
 		DEBUG_PRINTF ("Error: invalid message destination %hu. Ignoring message.\n", msg.Dest());
 		continue; // Error was reported in AllocateMrid
@@ -281,6 +313,15 @@ void App::ProcessInputQueue (void) noexcept
 	    if (!msger)
 		continue; // errors for msger creation failures were reported in CreateMsger; here just try to continue
 
+	    // Scatter/gather body segments are passed through only to Msgers
+	    // that forward them, like COMRelay. The rest read a single block.
+	    if (msg.HasSegments() && !msger->Flag (f_ScatterGather))
+		msg.Gather();
+
+	    // Replies sent while dispatching a request are tagged with its id
+	    _replylink = { msg.Dest(), msg.Src() };
+	    _replyid = msg.RequestId();
+
 	    auto accepted = msger->Dispatch(msg);
 
 	    if (!accepted && msg.Dest() != mrid_Broadcast)
@@ -291,6 +332,7 @@ void App::ProcessInputQueue (void) noexcept
 		return Quit (EXIT_FAILURE);
 	}
     }
+    _replyid = Msg::NoRequest;
 }
 
 void App::ForwardReceivedSignals (void) noexcept
@@ -324,7 +366,7 @@ unsigned App::GetPollTimerList (pollfd* pfd, unsigned pfdsz, int& timeout) const
     // Note that there may be a timeout without any fds
     //
     auto npfd = 0u;
-    auto nearest = PTimer::TimerMax;
+    auto nearest = _nextdeadline;	// of requests
     for (auto t : _timers) {
 	if (t->Cmd() == PTimer::WatchCmd::Stop)
 	    continue;
@@ -340,7 +382,7 @@ unsigned App::GetPollTimerList (pollfd* pfd, unsigned pfdsz, int& timeout) const
     if (!_outq.empty())
 	timeout = 0;	// do not wait if there are messages to process
     else if (nearest == PTimer::TimerMax)	// wait indefinitely
-	timeout = -!!npfd;	// if no fds, then don't wait at all
+	timeout = -1;	// if no fds, then there is nothing to wait for
     else // get current time and compute timeout to nearest
 	timeout = max (nearest - PTimer::Now(), 0);
     return npfd;
@@ -375,6 +417,62 @@ void App::CheckPollTimers (const pollfd* fds) noexcept
 	    t->Fire();
 	cfd += hasFd;
     }
+    ExpireRequests (now);
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ Requests
+
+Msg::reqid_t App::MakeRequest (const Msg::Link& l, mstime_t timeoutms) noexcept
+{
+    assert (!_outq.empty() && _outq.back().Src() == l.src && _outq.back().Dest() == l.dest
+	    && "a request must be made right after sending its message");
+    if (++_lastreqid == Msg::NoRequest)
+	++_lastreqid;
+    _outq.back().SetRequestId (_lastreqid);
+    auto deadline = PTimer::Now() + timeoutms;
+    _requests.push_back (Request { deadline, _lastreqid, l.src, l.dest });
+    _nextdeadline = min (_nextdeadline, deadline);
+    return _lastreqid;
+}
+
+void App::CompleteRequest (const Msg& msg) noexcept
+{
+    // Replies usually arrive in request order, so the search is short
+    for (auto i = _requests.begin(); i < _requests.end(); ++i) {
+	if (i->id == msg.RequestId()) {
+	    if (i->caller == msg.Dest() && i->callee == msg.Src())
+		_requests.erase (i);
+	    break;
+	}
+    }
+}
+
+void App::ExpireRequests (mstime_t now) noexcept
+{
+    if (now < _nextdeadline)
+	return;
+
+    // Timeout handlers may make new requests, so expired ones are moved out first
+    vector<Request> expired;
+    _nextdeadline = PTimer::TimerMax;
+    for (auto& r : _requests) {
+	if (r.deadline <= now)
+	    expired.push_back (r);
+	else
+	    _nextdeadline = min (_nextdeadline, r.deadline);
+    }
+    remove_if (_requests, [&](const auto& r) { return r.deadline <= now; });
+
+    for (auto& r : expired) {
+	DEBUG_PRINTF ("[T]\tRequest %u from %hu to %hu timed out\n", r.id, r.caller, r.callee);
+	auto m = _msgers[r.caller];
+	if (!m)
+	    continue;
+	m->OnRequestTimeout (r.id);
+	if (!Errors().empty() && !ForwardError (r.caller, r.caller))
+	    return Quit (EXIT_FAILURE);
+    }
 }
 
 } // namespace cwiclo
@@ -117,7 +117,8 @@ public:
     inline int		Run (void) noexcept;
     Msg::Link&		CreateLink (Msg::Link& l, iid_t iid) noexcept;
     Msg::Link&		CreateLinkWith (Msg::Link& l, iid_t iid, Msger::pfn_factory_t fac) noexcept;
-    inline Msg&		CreateMsg (Msg::Link& l, methodid_t mid, streamsize size, mrid_t extid = 0, Msg::fdoffset_t fdo = Msg::NoFdIncluded) noexcept;
+    inline Msg&		CreateMsg (Msg::Link& l, methodid_t mid, streamsize size, mrid_t extid = 0, Msg::fdoffset_t fdo = Msg::NoFdIncluded, Msg::fdcount_t nfds = 1) noexcept;
+    inline Msg&		CreateMsg (Msg::Link& l, methodid_t mid, const Msg::SharedBody& body) noexcept;
     inline void		ForwardMsg (Msg&& msg, Msg::Link& l) noexcept;
     static iid_t	InterfaceByName (const char* iname, streamsize inamesz) noexcept;
     msgq_t::size_type	HasMessagesFor (mrid_t mid) const noexcept;
@@ -132,6 +133,10 @@ public:
     unsigned		GetPollTimerList (pollfd* pfd, unsigned pfdsz, int& timeout) const noexcept;
     void		CheckPollTimers (const pollfd* fds) noexcept;
     bool		ForwardError (mrid_t oid, mrid_t eoid) noexcept;
+    Msg::reqid_t	MakeRequest (const Msg::Link& l, mstime_t timeoutms) noexcept;
+    // Id of the request, or reply, being dispatched, for matching replies
+    auto		DispatchedRequestId (void) const { return _replyid; }
+    void		Prioritize (const Msg::Link& l, Msg::Priority p) noexcept;
 #ifdef NDEBUG
     void		Errorv (const char* fmt, va_list args) noexcept	{ _errors.appendv (fmt, args); }
 #else
@@ -150,6 +155,16 @@ private:
 	Msger::pfn_factory_t	factory;
     };
     //}}}2--------------------------------------------------------------
+    //{{{2 Request -----------------------------------------------------
+    // An outstanding request, completed by a reply from callee to
+    // caller with the same id, or timed out at deadline.
+    struct Request {
+	mstime_t	deadline;
+	Msg::reqid_t	id;
+	mrid_t		caller;
+	mrid_t		callee;
+    };
+    //}}}2--------------------------------------------------------------
 public:
     //{{{2 Timer
     friend class Timer;
@@ -193,12 +208,21 @@ private:
     void		AddTimer (Timer* t)	{ _timers.push_back(t); }
     void		RemoveTimer (Timer* t)	{ remove_if (_timers, [&](auto i){ return i == t; }); }
     inline void		RunTimers (void) noexcept;
+    inline void		TagReply (Msg& msg) const;
+    void		QueueByPriority (void) noexcept;
+    inline void		CompleteRequest (const Msg& msg) noexcept;
+    void		ExpireRequests (mstime_t now) noexcept;
 private:
     msgq_t		_outq;
     msgq_t		_inq;
     vector<Msger*>	_msgers;
     vector<Timer*>	_timers;
     vector<mrid_t>	_creators;
+    vector<Request>	_requests;	// in order made
+    mstime_t		_nextdeadline;	// of _requests, or later
+    Msg::Link		_replylink;	// replies to the request being dispatched
+    Msg::reqid_t	_replyid;	// and its id
+    Msg::reqid_t	_lastreqid;
     string		_errors;
     static App*		s_pApp;
     static const MsgerImplements s_MsgerImpls[];
@@ -215,6 +239,11 @@ App::App (void) noexcept
 ,_msgers()
 ,_timers()
 ,_creators()
+,_requests()
+,_nextdeadline (PTimer::TimerMax)
+,_replylink()
+,_replyid (Msg::NoRequest)
+,_lastreqid (Msg::NoRequest)
 ,_errors()
 {
     assert (!s_pApp && "there must be only one App object");
@@ -237,7 +266,7 @@ int App::Run (void) noexcept
 void App::RunTimers (void) noexcept
 {
     auto ntimers = HasTimers();
-    if (!ntimers || Flag(f_Quitting)) {
+    if ((!ntimers && _requests.empty()) || Flag(f_Quitting)) {
 	if (_outq.empty()) {
 	    DEBUG_PRINTF ("Warning: ran out of packets. Quitting.\n");
 	    SetFlag (f_Quitting);	// running out of packets is usually not what you want, but not exactly an error
@@ -249,7 +278,7 @@ void App::RunTimers (void) noexcept
     pollfd fds [ntimers];
     int timeout;
     auto nfds = GetPollTimerList (fds, ntimers, timeout);
-    if (!nfds && !timeout) {
+    if (!nfds && timeout < 0 && _requests.empty()) {
 	if (_outq.empty()) {
 	    DEBUG_PRINTF ("Warning: ran out of packets. Quitting.\n");
 	    SetFlag (f_Quitting);	// running out of packets is usually not what you want, but not exactly an error
@@ -284,14 +313,31 @@ void App::Timer::Timer_Watch (PTimer::WatchCmd cmd, PTimer::fd_t fd, mstime_t ti
     _nextfire = timeoutms + (timeoutms <= PTimer::TimerMax ? PTimer::Now() : PTimer::TimerNone);
 }
 
-Msg& App::CreateMsg (Msg::Link& l, methodid_t mid, streamsize size, mrid_t extid, Msg::fdoffset_t fdo) noexcept
+void App::TagReply (Msg& msg) const
+{
+    if (_replyid != Msg::NoRequest && msg.Src() == _replylink.src && msg.Dest() == _replylink.dest)
+	msg.SetRequestId (_replyid);
+}
+
+Msg& App::CreateMsg (Msg::Link& l, methodid_t mid, streamsize size, mrid_t extid, Msg::fdoffset_t fdo, Msg::fdcount_t nfds) noexcept
+{
+    auto& msg = _outq.emplace_back (CreateLink(l,InterfaceOfMethod(mid)),mid,size,extid,fdo,nfds);
+    TagReply (msg);
+    return msg;
+}
+
+Msg& App::CreateMsg (Msg::Link& l, methodid_t mid, const Msg::SharedBody& body) noexcept
 {
-    return _outq.emplace_back (CreateLink(l,InterfaceOfMethod(mid)),mid,size,extid,fdo);
+    auto& msg = _outq.emplace_back (CreateLink(l,InterfaceOfMethod(mid)),mid,body);
+    TagReply (msg);
+    return msg;
 }
 
 void App::ForwardMsg (Msg&& msg, Msg::Link& l) noexcept
 {
-    _outq.emplace_back (move(msg), CreateLink(l,msg.Interface()));
+    auto& fmsg = _outq.emplace_back (move(msg), CreateLink(l,msg.Interface()));
+    if (_outq.size() > 1 && _outq[_outq.size()-2].GetPriority() < fmsg.GetPriority())
+	QueueByPriority();
 }
 
 //}}}-------------------------------------------------------------------
@@ -0,0 +1,151 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "compress.h"
+
+//{{{ Format -----------------------------------------------------------
+namespace cwiclo {
+namespace {
+
+// The compressed block is a sequence of literal runs and matches.
+// Each sequence starts with a token byte, with the literal run length
+// in the high nibble and match length-c_MinMatch in the low nibble.
+// A nibble value of 15 is followed by extension bytes, added to it
+// until a byte less than 255. After the literal run is the 16 bit
+// little-endian match offset, back from the current position. The last
+// sequence contains only literals, ending the block.
+//
+enum : streamsize {
+    c_MinMatch = 4,
+    c_LastLiterals = 5,	// the format requires the last 5 bytes be literals
+    c_MatchSearchEnd = 12,	// ... and the last match start 12 bytes before the end
+    c_MaxOffset = UINT16_MAX,
+    c_HashBits = 12,
+    c_SkipTrigger = 6	// speed up search in incompressible data
+};
+
+inline static uint32_t load32 (const uint8_t* p)
+    { uint32_t v; memcpy (&v, p, sizeof(v)); return v; }
+inline static unsigned lz_hash (uint32_t v)
+    { return (v * 2654435761u) >> (32-c_HashBits); }
+
+inline static uint8_t* write_length (uint8_t* op, streamsize n)
+{
+    for (; n >= UINT8_MAX; n -= UINT8_MAX)
+	*op++ = UINT8_MAX;
+    *op++ = n;
+    return op;
+}
+
+inline static bool read_length (const uint8_t*& ip, const uint8_t* iend, streamsize& n)
+{
+    for (uint8_t b = UINT8_MAX; b == UINT8_MAX;) {
+	if (ip >= iend || n > numeric_limits<streamsize>::max()/2)
+	    return false;
+	n += (b = *ip++);
+    }
+    return true;
+}
+
+// Writes a sequence header and literals, returns nullptr if out of space
+inline static uint8_t* write_literals (uint8_t* op, const uint8_t* oend, const uint8_t* lit, streamsize litlen, streamsize mlen)
+{
+    // token, literal length, literals, offset, match length
+    if (streamsize(oend-op) < 1+litlen/UINT8_MAX+1+litlen+2+mlen/UINT8_MAX+1)
+	return nullptr;
+    auto token = op++;
+    *token = min (litlen, streamsize(15)) << 4 | min (mlen, streamsize(15));
+    if (litlen >= 15)
+	op = write_length (op, litlen-15);
+    return copy_n (lit, litlen, op);
+}
+
+} // namespace
+//}}}-------------------------------------------------------------------
+//{{{ lz_compress
+
+streamsize lz_compress (const void* vsrc, streamsize srcsz, void* vdest, streamsize destsz) noexcept
+{
+    auto src = static_cast<const uint8_t*>(vsrc), ip = src, anchor = src, iend = src+srcsz;
+    auto dest = static_cast<uint8_t*>(vdest), op = dest, oend = dest+destsz;
+
+    if (srcsz > c_MatchSearchEnd) {
+	// Hash table of last positions where each 4 byte value was seen
+	uint32_t htab [1u<<c_HashBits] = {};
+	auto searchend = iend-c_MatchSearchEnd, matchend = iend-c_LastLiterals;
+	for (auto misses = 0u; ip < searchend;) {
+	    auto v = load32 (ip);
+	    auto& hpos = htab [lz_hash (v)];
+	    auto ref = src + hpos;
+	    hpos = ip - src;
+	    if (ref >= ip || ip-ref > c_MaxOffset || load32 (ref) != v) {
+		ip += 1 + (misses++ >> c_SkipTrigger);
+		continue;
+	    }
+	    misses = 0;
+	    // Extend the match backwards into pending literals, then forward
+	    while (ip > anchor && ref > src && ip[-1] == ref[-1])
+		--ip, --ref;
+	    auto mp = ip+c_MinMatch, mr = ref+c_MinMatch;
+	    while (mp < matchend && *mp == *mr)
+		++mp, ++mr;
+	    streamsize mlen = mp-ip-c_MinMatch;
+	    if (!(op = write_literals (op, oend, anchor, ip-anchor, mlen)))
+		return 0;
+	    auto off = ip-ref;
+	    *op++ = off;
+	    *op++ = off >> 8;
+	    if (mlen >= 15)
+		op = write_length (op, mlen-15);
+	    anchor = ip = mp;
+	    if (ip < searchend)	// Index the end of the match for the next search
+		htab [lz_hash (load32 (ip-2))] = ip-2-src;
+	}
+    }
+    // The block ends with the remaining literals
+    if (!(op = write_literals (op, oend, anchor, iend-anchor, 0)))
+	return 0;
+    return op-dest;
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ lz_decompress
+
+streamsize lz_decompress (const void* vsrc, streamsize srcsz, void* vdest, streamsize destsz) noexcept
+{
+    auto ip = static_cast<const uint8_t*>(vsrc), iend = ip+srcsz;
+    auto dest = static_cast<uint8_t*>(vdest), op = dest, oend = dest+destsz;
+    while (ip < iend) {
+	auto token = *ip++;
+	streamsize litlen = token >> 4;
+	if (litlen == 15 && !read_length (ip, iend, litlen))
+	    return 0;
+	if (litlen > streamsize(iend-ip) || litlen > streamsize(oend-op))
+	    return 0;
+	op = copy_n (ip, litlen, op);
+	ip += litlen;
+	if (ip == iend)
+	    break;	// the last sequence has no match
+	if (iend-ip < 2)
+	    return 0;
+	streamsize off = ip[0] | ip[1] << 8;
+	ip += 2;
+	streamsize mlen = token & 15;
+	if (mlen == 15 && !read_length (ip, iend, mlen))
+	    return 0;
+	mlen += c_MinMatch;
+	if (!off || off > streamsize(op-dest) || mlen > streamsize(oend-op))
+	    return 0;
+	auto mp = op-off;
+	if (off >= mlen)
+	    op = copy_n (mp, mlen, op);
+	else for (auto mpe = op+mlen; op < mpe;)	// overlapping copy repeats the pattern
+	    *op++ = *mp++;
+    }
+    return op-dest;
+}
+
+} // namespace cwiclo
+//}}}-------------------------------------------------------------------
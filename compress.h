@@ -0,0 +1,27 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#pragma once
+#include "stream.h"
+
+namespace cwiclo {
+
+// A fast LZ77 codec using the LZ4 block format. It is meant for
+// compressing messages on the fly, trading ratio for speed.
+
+/// Returns the buffer size sufficient to compress any \p n bytes.
+inline constexpr streamsize lz_compress_bound (streamsize n)
+    { return n + n/255 + 16; }
+
+/// Compresses \p srcsz bytes at \p src into \p dest.
+/// Returns compressed size, or 0 if it does not fit into \p destsz.
+streamsize lz_compress (const void* src, streamsize srcsz, void* dest, streamsize destsz) noexcept NONNULL();
+
+/// Decompresses \p srcsz bytes at \p src into \p dest.
+/// Returns decompressed size, or 0 if the input is invalid or
+/// does not fit into \p destsz. Safe to use on untrusted input.
+streamsize lz_decompress (const void* src, streamsize srcsz, void* dest, streamsize destsz) noexcept NONNULL();
+
+} // namespace cwiclo
@@ -0,0 +1,59 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+//
+// config.h generated by configure
+#pragma once
+
+// Define to the one symbol short name of this package.
+#define CWICLO_NAME		"cwiclo"
+// Define to the version of this package.
+#define CWICLO_VERSION		0x
+// Define to the version string of this package.
+#define CWICLO_VERSTRING	"1cb6765"
+// Define to the address where bug reports for this package should be sent.
+#define CWICLO_BUGREPORT	"Mike Sharov <msharov@users.sourceforge.net>"
+
+// Common includes
+#include <stddef.h>
+#include <stdbool.h>
+#if __has_include(<sys/types.h>)
+    #include <sys/types.h>
+#endif
+#if __has_include(<stdint.h>)
+    #include <stdint.h>
+#elif __has_include(<inttypes.h>)
+    #include <inttypes.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <assert.h>
+
+// gcc attribute shortcuts
+#define PRINTFARGS(fmt,args)    __attribute__((__format__(__printf__,fmt,args)))
+#define CONST                   __attribute__((const))
+#define PURE                    __attribute__((pure))
+#define MALLOCLIKE              __attribute__((malloc))
+#define WEAKSYM			__attribute__((weak))
+#define WEAKALIAS(sym)		__attribute__((weak,alias(sym)))
+#define FORMATARG(fmt)          __attribute__((format_arg(fmt)))
+#define NONNULL(...)            __attribute__((nonnull(__VA_ARGS__)))
+#define likely(x)               __builtin_expect(!!(x), 1)
+#define unlikely(x)             __builtin_expect(!!(x), 0)
+#define compile_constant(x)     __builtin_constant_p(x)
+#if __clang__
+    #define MALLOCLIKE_ARG(...)
+#else
+    #define MALLOCLIKE_ARG(...)	__attribute__((alloc_size(__VA_ARGS__)))
+#endif
+#if defined(NDEBUG) && !defined(inline)
+    #define inline		__attribute__((always_inline)) inline
+#endif
+#if __i386__ || __x86_64__
+    #define __x86__ 1
+#endif
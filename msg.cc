@@ -19,11 +19,9 @@ methodid_t LookupInterfaceMethod (iid_t iid, const char* __restrict__ mname, siz
 
 //----------------------------------------------------------------------
 
-auto& ProxyB::LinkW (void) noexcept { return _link; }
-
-Msg& ProxyB::CreateMsg (methodid_t mid, streamsize sz) noexcept
+Msg& ProxyB::CreateMsg (methodid_t mid, streamsize sz, Msg::fdoffset_t fdo, Msg::fdcount_t nfds) noexcept
 {
-    return App::Instance().CreateMsg (LinkW(), mid, sz);
+    return App::Instance().CreateMsg (LinkW(), mid, sz, 0, fdo, nfds);
 }
 
 void ProxyB::Forward (Msg&& msg) noexcept
@@ -31,6 +29,12 @@ void ProxyB::Forward (Msg&& msg) noexcept
     App::Instance().ForwardMsg (move(msg), LinkW());
 }
 
+void ProxyB::Send (methodid_t mid, const Msg::SharedBody& body) noexcept
+{
+    [[maybe_unused]] auto& msg = App::Instance().CreateMsg (LinkW(), mid, body);
+    assert (msg.Size() == msg.Verify() && "Message body does not match method signature");
+}
+
 #ifndef NDEBUG
 void ProxyB::CommitMsg (Msg& msg, ostream& os) noexcept
 {
@@ -58,6 +62,22 @@ void Proxy::FreeId (void) noexcept
 	app.FreeMrid (Dest());
 }
 
+// Makes the message last sent through this proxy a request, expecting
+// a reply within timeoutms. If none arrives, the caller's
+// OnRequestTimeout is called with the returned request id.
+Msg::reqid_t Proxy::Request (uint64_t timeoutms) noexcept
+{
+    return App::Instance().MakeRequest (Link(), timeoutms);
+}
+
+// Sets the priority of the message last sent through this proxy,
+// which then overtakes queued messages of lower priority. If the
+// message is a request, this must follow the Request call.
+void ProxyB::Prioritize (Msg::Priority p) noexcept
+{
+    App::Instance().Prioritize (Link(), p);
+}
+
 //----------------------------------------------------------------------
 
 void Msger::Error (const char* fmt, ...) noexcept // static
@@ -75,16 +95,39 @@ void Msger::ErrorLibc (const char* f) noexcept // static
 
 //----------------------------------------------------------------------
 
-Msg::Body::~Body (void) noexcept { fill_n (begin(), size(), value_type(0)); }
+Msg::SharedBody::SharedBody (memblock&& data) noexcept
+: _p (new Block { move(data), 1 })
+{
+}
+
+Msg::SharedBody::~SharedBody (void) noexcept
+{
+    if (_p && !--_p->refs) {
+	fill_n (_p->data.begin(), _p->data.size(), char(0));
+	delete _p;
+    }
+}
+
+Msg::Body::~Body (void) noexcept
+{
+    if (capacity())	// linked memory belongs to someone else
+	fill_n (begin(), size(), value_type(0));
+}
+
+const Msg::seglist_t Msg::c_NoSegments;
 
 //----------------------------------------------------------------------
 
-Msg::Msg (const Link& l, methodid_t mid, streamsize size, mrid_t extid, fdoffset_t fdo) noexcept
+Msg::Msg (const Link& l, methodid_t mid, streamsize size, mrid_t extid, fdoffset_t fdo, fdcount_t nfds) noexcept
 :_method (mid)
 ,_link (l)
 ,_extid (extid)
 ,_fdoffset (fdo)
+,_nfds (nfds)
 ,_body (Align (size, Alignment::Body))
+,_reqid (NoRequest)
+,_priority (Priority::Normal)
+,_chain()
 {
     // Message body is padded to Alignment::Body
     auto ppade = _body.end();
@@ -93,13 +136,25 @@ Msg::Msg (const Link& l, methodid_t mid, streamsize size, mrid_t extid, fdoffset
 	*p = 0;
 }
 
-Msg::Msg (const Link& l, methodid_t mid, memblock&& body, mrid_t extid, fdoffset_t fdo) noexcept
+Msg::Msg (const Link& l, methodid_t mid, Body&& body, mrid_t extid, fdoffset_t fdo, fdcount_t nfds) noexcept
 :_method (mid)
 ,_link (l)
 ,_extid (extid)
 ,_fdoffset (fdo)
+,_nfds (nfds)
 ,_body (move (body))
+,_reqid (NoRequest)
+,_priority (Priority::Normal)
+,_chain()
+{
+}
+
+// The body links to the shared data, referenced from the chain
+Msg::Msg (const Link& l, methodid_t mid, const SharedBody& body) noexcept
+: Msg (l, mid, Body (body.data(), body.size()))
 {
+    _chain = make_unique<Chain>();
+    _chain->shared = SharedBody (body);
 }
 
 Msg::~Msg (void) noexcept
@@ -107,6 +162,98 @@ Msg::~Msg (void) noexcept
     *reinterpret_cast<simd16_t*>(this) = simd16_t::zero();
 }
 
+void Msg::Gather (void) noexcept
+{
+    if (!HasSegments())
+	return;
+    auto bsz = _body.size(), sz = Size();
+    _body.reserve (Align (sz, Alignment::Body));
+    _body.memlink::resize (sz);
+    auto p = _body.iat (bsz);
+    for (auto& s : _chain->segs)
+	p = copy_n (s.data(), s.size(), p);
+    for (auto pe = _body.data()+_body.capacity(); p < pe; ++p)
+	*p = 0;	// padding to Alignment::Body
+    _chain.reset();	// the body now has its own copy
+}
+
+void Msg::AppendSegment (Segment&& seg) noexcept
+{
+    if (!_chain)
+	_chain = make_unique<Chain>();
+    _chain->segs.emplace_back (move(seg));
+}
+
+//----------------------------------------------------------------------
+
+namespace {
+
+// Reads a scatter/gather message body as a single stream. Used only
+// for validation, which needs little more than skipping and sizes.
+// Alignment is computed from the body offset, which is equivalent
+// to istream's pointer alignment since bodies are allocated aligned.
+//
+class segistream {
+public:
+			segistream (const Msg::Body& body, const Msg::seglist_t& segs)
+			    :_p(body.begin()),_e(body.end()),_seg(segs.begin()),_segend(segs.end()),_pos(),_rem(body.size())
+			    { for (auto& s : segs) _rem += s.size(); }
+    streamsize		remaining (void) const		{ return _rem; }
+    streamsize		alignsz (streamsize g) const	{ return Align (_pos, g) - _pos; }
+    bool		can_align (streamsize g) const	{ return alignsz(g) <= remaining(); }
+    bool		aligned (streamsize g) const	{ return !alignsz(g); }
+    void		align (streamsize g)		{ skip (alignsz(g)); }
+    void		skip (streamsize n) {
+			    assert (n <= remaining());
+			    _pos += n;
+			    _rem -= n;
+			    while (n > streamsize(_e-_p)) {
+				n -= _e-_p;
+				_p = _seg->begin();
+				_e = _seg->end();
+				++_seg;
+			    }
+			    _p += n;
+			}
+    bool		has_zero (streamsize n) const {
+			    assert (n <= remaining());
+			    auto p = _p, e = _e;
+			    for (auto seg = _seg;; p = seg->begin(), e = seg->end(), ++seg) {
+				auto sn = min (n, streamsize(e-p));
+				if (memchr (p, 0, sn))
+				    return true;
+				if (!(n -= sn))
+				    return false;
+			    }
+			}
+    template <typename T>
+    T			readv (void) {
+			    T v;
+			    auto d = reinterpret_cast<char*>(&v);
+			    for (auto i = 0u; i < sizeof(v); ++i) {
+				while (_p == _e && _seg < _segend) {
+				    _p = _seg->begin();
+				    _e = _seg->end();
+				    ++_seg;
+				}
+				d[i] = *_p;
+				skip (1);
+			    }
+			    return v;
+			}
+private:
+    const char*		_p;
+    const char*		_e;
+    const Msg::Segment*	_seg;
+    const Msg::Segment*	_segend;
+    streamsize		_pos;
+    streamsize		_rem;
+};
+
+} // namespace
+
+//----------------------------------------------------------------------
+
 static streamsize SigelementSize (char c) noexcept
 {
     static const struct { char sym; uint8_t sz; } syms[] =
@@ -143,7 +290,8 @@ static streamsize SigelementAlignment (const char* sig) noexcept
     return sz;
 }
 
-static bool ValidateReadAlign (istream& is, streamsize& sz, streamsize grain) noexcept
+template <typename Stm>
+static bool ValidateReadAlign (Stm& is, streamsize& sz, streamsize grain) noexcept
 {
     if (!is.can_align (grain))
 	return false;
@@ -152,7 +300,49 @@ static bool ValidateReadAlign (istream& is, streamsize& sz, streamsize grain) no
     return true;
 }
 
-static streamsize ValidateSigelement (istream& is, const char*& sig) noexcept
+// Checks for embedded zeroes in the next n bytes. memchr is vectorized
+// in libc, and runs at memory bandwidth on long strings.
+static bool HasZero (const istream& is, streamsize n) noexcept
+    { return memchr (is.ptr<char>(), 0, n); }
+static bool HasZero (const segistream& is, streamsize n) noexcept
+    { return is.has_zero (n); }
+
+// Validates the string at the current position, already 4-aligned,
+// with its size read into n. A strict check also rejects embedded zeroes.
+template <typename Stm>
+static bool ValidateString (Stm& is, streamsize n, bool strict) noexcept
+{
+    if (is.remaining() < n)
+	return false;
+    if (!n)
+	return true;
+    if (strict && HasZero (is, n-1))
+	return false;
+    is.skip (n-1);
+    return !is.template readv<char>();
+}
+
+// Arrays of strings are common and can be large, so they are validated
+// in a single loop instead of recursing for each element.
+template <typename Stm>
+static streamsize ValidateStringArray (Stm& is, uint32_t nel, bool strict) noexcept
+{
+    streamsize sz = 0;
+    for (auto i = 0u; i < nel; ++i) {
+	if (is.remaining() < 4)
+	    return 0;
+	streamsize n = is.template readv<uint32_t>();
+	if (!ValidateString (is, n, strict))
+	    return 0;
+	sz += 4 + n;
+	if (!ValidateReadAlign (is, sz, 4))
+	    return 0;
+    }
+    return sz;
+}
+
+template <typename Stm>
+static streamsize ValidateSigelement (Stm& is, const char*& sig, bool strict) noexcept
 {
     auto sz = SigelementSize (*sig);
     assert ((sz || *sig == '(' || *sig == 'a' || *sig == 's') && "invalid character in method signature");
@@ -167,14 +357,14 @@ static streamsize ValidateSigelement (istream& is, const char*& sig) noexcept
 	    return 0;
 	++sig;
 	for (streamsize ssz; *sig && *sig != ')'; sz += ssz)
-	    if (!(ssz = ValidateSigelement (is, sig)))
+	    if (!(ssz = ValidateSigelement (is, sig, strict)))
 		return 0;		// invalid data in buf, return 0 as error
-	if (!ValidateReadAlign (is, sz, sal))	// align after the struct
+	if (*sig++ != ')' || !ValidateReadAlign (is, sz, sal))	// align after the struct
 	    return 0;
     } else if (*sig == 'a' || *sig == 's') {		// Arrays and strings
 	if (is.remaining() < 4 || !is.aligned(4))
 	    return 0;
-	uint32_t nel; is >> nel;	// number of elements in the array
+	auto nel = is.template readv<uint32_t>();	// number of elements in the array
 	sz += 4;
 	size_t elsz = 1, elal = 4;	// strings are equivalent to "ac"
 	if (*sig++ == 'a') {		// arrays are followed by an element sig "a(uqq)"
@@ -183,35 +373,40 @@ static streamsize ValidateSigelement (istream& is, const char*& sig) noexcept
 	}
 	if (!ValidateReadAlign (is, sz, elal))	// align the beginning of element block
 	    return 0;
-	if (elsz) {			// optimization for the common case of fixed-element array
+	if (sig[-1] == 's') {		// for strings, verify zero-termination
+	    if (!ValidateString (is, nel, strict))
+		return 0;
+	    sz += nel;
+	} else if (elsz) {		// optimization for the common case of fixed-element array
 	    auto allelsz = elsz*nel;
 	    if (is.remaining() < allelsz)
 		return 0;
 	    is.skip (allelsz);
 	    sz += allelsz;
+	} else if (*sig == 's') {	// string arrays are validated in bulk
+	    auto allelsz = ValidateStringArray (is, nel, strict);
+	    if (nel && !allelsz)
+		return 0;
+	    sz += allelsz;
 	} else for (auto i = 0u; i < nel; ++i, sz += elsz) {	// read each element
 	    auto elsig = sig;		// for each element, pass in the same element sig
-	    if (!(elsz = ValidateSigelement (is, elsig)))
+	    if (!(elsz = ValidateSigelement (is, elsig, strict)))
 		return 0;
 	}
 	if (sig[-1] == 'a')		// skip the array element sig for arrays; strings do not have one
 	    sig = SkipOneSigelement (sig);
-	else {				// for strings, verify zero-termination
-	    is.unread (1);
-	    if (is.readv<char>())
-		return 0;
-	}
 	if (!ValidateReadAlign (is, sz, elal))	// align the end of element block, if element alignment < 4
 	    return 0;
     }
     return sz;
 }
 
-streamsize Msg::ValidateSignature (istream& is, const char* sig) noexcept // static
+template <typename Stm>
+static streamsize ValidateSigelements (Stm& is, const char* sig, bool strict = false) noexcept
 {
     streamsize sz = 0;
     while (*sig) {
-	auto elsz = ValidateSigelement (is, sig);
+	auto elsz = ValidateSigelement (is, sig, strict);
 	if (!elsz)
 	    return 0;
 	sz += elsz;
@@ -219,4 +414,17 @@ streamsize Msg::ValidateSignature (istream& is, const char* sig) noexcept // sta
     return sz;
 }
 
+streamsize Msg::ValidateSignature (istream& is, const char* sig, bool strict) noexcept // static
+    { return ValidateSigelements (is, sig, strict); }
+
+streamsize Msg::Verify (void) const noexcept
+{
+    if (!HasSegments()) {
+	auto is = Read();
+	return ValidateSignature (is, Signature());
+    }
+    segistream is (_body, _chain->segs);
+    return ValidateSigelements (is, Signature());
+}
+
 } // namespace cwiclo
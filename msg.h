@@ -135,6 +135,32 @@ public:
 	mrid_t	src;
 	mrid_t	dest;
     };
+    // Immutable body data referenced by many messages. Use it to send
+    // the same payload to many Msgers or Externs without marshalling
+    // it for each one. The reference count is not atomic, since all
+    // messages live in the App thread.
+    class SharedBody {
+	struct Block {
+	    memblock	data;
+	    uint32_t	refs;
+	};
+    public:
+	constexpr	SharedBody (void)		: _p() {}
+	explicit	SharedBody (memblock&& data) noexcept;
+			SharedBody (const SharedBody& v)	: _p(v._p) { if (_p) ++_p->refs; }
+			SharedBody (SharedBody&& v)	: _p (exchange (v._p, nullptr)) {}
+			~SharedBody (void) noexcept;
+	SharedBody&	operator= (SharedBody&& v)	{ ::cwiclo::swap (_p, v._p); return *this; }
+	void		operator= (const SharedBody&) = delete;
+	bool		empty (void) const	{ return !_p; }
+	const char*	data (void) const	{ return _p ? _p->data.data() : nullptr; }
+	streamsize	size (void) const	{ return _p ? _p->data.size() : 0; }
+	auto		use_count (void) const	{ return _p ? _p->refs : 0; }
+    private:
+	Block*		_p;
+    };
+    // The body block is owned by the message, or links to a SharedBody
+    // or to caller's memory. Only owned blocks are wiped on free.
     class Body : public memblock {
     public:
 	using memblock::memblock;
@@ -142,34 +168,82 @@ public:
 	Body (memblock&& v) : memblock(move(v)) {}
 	~Body (void) noexcept;
     };
+    // Large payloads can be attached as additional body segments,
+    // forming a scatter/gather chain after the body. A segment may
+    // own its memory, or link to the caller's memory, which must then
+    // remain valid until the message is written.
+    using Segment = Body;
+    using seglist_t = vector<Segment>;
+    // Segments, and the reference to a SharedBody linked as the body,
+    // are kept in a separately allocated Chain, so that messages not
+    // using them remain small.
+    struct Chain {
+	seglist_t	segs;
+	SharedBody	shared;
+    };
+    using chainptr_t = unique_ptr<Chain>;
+    static const seglist_t c_NoSegments;
+    // Fds passed to another process through an Extern are in the body
+    // at fdoffset, either one "h" value, or nfds elements of an "ah"
+    // fd array. Several fds can only be passed as an fd array.
     using fdoffset_t = uint8_t;
+    using fdcount_t = uint8_t;
     static constexpr fdoffset_t NoFdIncluded = numeric_limits<fdoffset_t>::max();
+    // Requests are messages expecting a reply within a deadline,
+    // numbered by the App. Replies sent while dispatching a request
+    // carry its id, correlating them even when many are outstanding.
+    using reqid_t = uint32_t;
+    static constexpr reqid_t NoRequest = 0;
+    // Messages of higher priority overtake queued messages of lower
+    // priority, in the App queue and in the Extern write queue, but
+    // never those on their own link, which are delivered in order.
+    // Control messages are High. Low is for bulk data.
+    enum class Priority : uint8_t { Low, Normal, High };
     struct Alignment {
 	static constexpr streamsize Header = 8;
 	static constexpr streamsize Body = Header;
 	static constexpr streamsize Fd = alignof(int);
     };
 public:
-			Msg (const Link& l, methodid_t mid, streamsize size, mrid_t extid = 0, fdoffset_t fdo = NoFdIncluded) noexcept;
-			Msg (const Link& l, methodid_t mid, memblock&& body, mrid_t extid = 0, fdoffset_t fdo = NoFdIncluded) noexcept;
+			Msg (const Link& l, methodid_t mid, streamsize size, mrid_t extid = 0, fdoffset_t fdo = NoFdIncluded, fdcount_t nfds = 1) noexcept;
+			Msg (const Link& l, methodid_t mid, Body&& body, mrid_t extid = 0, fdoffset_t fdo = NoFdIncluded, fdcount_t nfds = 1) noexcept;
+			Msg (const Link& l, methodid_t mid, const SharedBody& body) noexcept;
 			~Msg (void) noexcept;
     inline auto&	GetLink (void) const	{ return _link; }
     inline auto		Src (void) const	{ return GetLink().src; }
     inline auto		Dest (void) const	{ return GetLink().dest; }
-    inline auto		Size (void) const	{ return _body.size(); }
+    inline streamsize	Size (void) const	{ return _body.size() + SegmentsSize(); }
+    inline streamsize	SegmentsSize (void) const {
+			    streamsize sz = 0;
+			    for (auto& s : Segments())
+				sz += s.size();
+			    return sz;
+			}
     inline auto		Method (void) const	{ return _method; }
     inline auto		Interface (void) const	{ return InterfaceOfMethod (Method()); }
     inline auto		Signature (void) const	{ return SignatureOfMethod (Method()); }
     inline auto		Extid (void) const	{ return _extid; }
     inline void		SetExtid (mrid_t eid)	{ _extid = eid; }
     inline auto		FdOffset (void) const	{ return _fdoffset; }
+    inline fdcount_t	FdCount (void) const	{ return _fdoffset == NoFdIncluded ? 0 : _nfds; }
+    inline auto		RequestId (void) const	{ return _reqid; }
+    inline void		SetRequestId (reqid_t id)	{ _reqid = id; }
+    inline auto		GetPriority (void) const	{ return _priority; }
+    inline void		SetPriority (Priority p)	{ _priority = p; }
+    inline auto&	GetBody (void) const	{ return _body; }
     inline auto&&	MoveBody (void)		{ return move(_body); }
-    inline istream	Read (void) const	{ return istream (_body); }
+    inline const seglist_t&	Segments (void) const	{ return _chain ? _chain->segs : c_NoSegments; }
+    inline bool		HasSegments (void) const	{ return _chain && !_chain->segs.empty(); }
+    inline auto&&	MoveChain (void)	{ return move(_chain); }
+    void		AppendSegment (Segment&& seg) noexcept;
+    void		Gather (void) noexcept;
+    inline istream	Read (void) const	{ assert (!HasSegments() && "Gather the body segments before reading"); return istream (_body); }
     inline ostream	Write (void)		{ return ostream (_body); }
-    static streamsize	ValidateSignature (istream& is, const char* sig) noexcept;
-    streamsize		Verify (void) const noexcept	{ auto is = Read(); return ValidateSignature (is, Signature()); }
-			Msg (Msg&& msg) : Msg(msg.GetLink(),msg.Method(),msg.MoveBody(),msg.Extid(),msg.FdOffset()) {}
-			Msg (Msg&& msg, const Link& l) : Msg(l,msg.Method(),msg.MoveBody(),msg.Extid(),msg.FdOffset()) {}
+    // Strict validation also rejects strings with embedded zeroes
+    static streamsize	ValidateSignature (istream& is, const char* sig, bool strict = false) noexcept;
+    streamsize		Verify (void) const noexcept;
+			Msg (Msg&& msg) : Msg(msg.GetLink(),msg.Method(),msg.MoveBody(),msg.Extid(),msg.FdOffset(),msg._nfds) { _reqid = msg._reqid; _priority = msg._priority; _chain = msg.MoveChain(); }
+			Msg (Msg&& msg, const Link& l) : Msg(l,msg.Method(),msg.MoveBody(),msg.Extid(),msg.FdOffset(),msg._nfds) { _reqid = msg._reqid; _priority = msg._priority; _chain = msg.MoveChain(); }
 			Msg (const Msg&) = delete;
     Msg&		operator= (const Msg&) = delete;
 private:
@@ -177,7 +251,11 @@ private:
     Link		_link;
     mrid_t		_extid;
     fdoffset_t		_fdoffset;
+    fdcount_t		_nfds;
     Body		_body;
+    reqid_t		_reqid;		// with _priority, in _chain alignment padding
+    Priority		_priority;
+    chainptr_t		_chain;		// only when segmented or shared
 };
 
 //}}}-------------------------------------------------------------------
@@ -190,12 +268,13 @@ public:
     constexpr auto&	Link (void) const			{ return _link; }
     constexpr auto	Src (void) const			{ return Link().src; }
     constexpr auto	Dest (void) const			{ return Link().dest; }
+    void		Prioritize (Msg::Priority p) noexcept;
 protected:
     constexpr		ProxyB (mrid_t from, mrid_t to)		: _link {from,to} {}
 			ProxyB (const ProxyB&) = delete;
-    inline auto&	LinkW (void) noexcept;
+    constexpr auto&	LinkW (void)				{ return _link; }
     void		operator= (const ProxyB&) = delete;
-    Msg&		CreateMsg (methodid_t imethod, streamsize sz) noexcept;
+    Msg&		CreateMsg (methodid_t imethod, streamsize sz, Msg::fdoffset_t fdo = Msg::NoFdIncluded, Msg::fdcount_t nfds = 1) noexcept;
     void		Forward (Msg&& msg) noexcept;
 #ifdef NDEBUG	// CommitMsg only does debug checking
     void		CommitMsg (Msg&, ostream&) noexcept	{ }
@@ -203,6 +282,7 @@ protected:
     void		CommitMsg (Msg& msg, ostream& os) noexcept;
 #endif
     inline void		Send (methodid_t imethod)		{ CreateMsg (imethod, 0); }
+    void		Send (methodid_t imethod, const Msg::SharedBody& body) noexcept;
     template <typename... Args>
     inline void Send (methodid_t imethod, const Args&... args) {
 	auto& msg = CreateMsg (imethod, variadic_stream_size(args...));
@@ -220,6 +300,7 @@ public:
     void		CreateDestAs (iid_t iid) noexcept;
     void		CreateDestWith (iid_t iid, pfn_factory_t fac) noexcept;
     void		FreeId (void) noexcept;
+    Msg::reqid_t	Request (uint64_t timeoutms) noexcept;
 };
 class ProxyR : public ProxyB {
 public:
@@ -245,7 +326,7 @@ struct has_msger_named_create : public __has_msger_named_create<T>::type {};
 
 class Msger {
 public:
-    enum { f_Unused, f_Static, f_Last };
+    enum { f_Unused, f_Static, f_ScatterGather, f_Last };
     //{{{2 Msger factory template --------------------------------------
     template <typename M>
     static Msger* Factory (const Msg::Link& l) {
@@ -269,6 +350,8 @@ public:
 			    { SetFlag (f_Unused); return false; }
     virtual void	OnMsgerDestroyed (mrid_t mid) noexcept
 			    { if (mid == CreatorId()) SetFlag (f_Unused); }
+    virtual void	OnRequestTimeout (Msg::reqid_t id) noexcept
+			    { Error ("request %u timed out", id); }
 protected:
     explicit		Msger (const Msg::Link& l)	:_link(l),_flags() {}
     explicit		Msger (mrid_t id)		:_link{id,id},_flags(BitMask(f_Static)) {}
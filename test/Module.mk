@@ -9,7 +9,7 @@ test/OUTS	:= ${test/TESTS:=.out}
 
 ################ Compilation ###########################################
 
-.PHONY:	test/all test/run test/clean test/check
+.PHONY:	test/all test/run test/clean test/check test/bench
 
 test/all:	${test/TESTS}
 
@@ -25,6 +25,14 @@ test/check:	${test/TESTS}
 	    diff $$TEST.std $$i.out && rm -f $$i.out;\
 	done
 
+# Benchmarks are not tests, so they are run separately
+#
+bench:		test/bench
+test/bench:	$Otest/xbench $Otest/xstorm
+	@$Otest/xbench
+	@$Otest/xbench -n 200000 -s 64
+	@$Otest/xstorm
+
 $Otest/tlibf:	$Otest/tlibf.o ${LIBA}
 	@echo "Linking $@ ..."
 	@${CC} ${LDFLAGS} -o $@ $^
@@ -33,6 +41,66 @@ $Otest/fwork:	$Otest/fwork.o $Otest/ping.o ${LIBA}
 	@echo "Linking $@ ..."
 	@${CC} ${LDFLAGS} -o $@ $^
 
+$Otest/xbulk:	$Otest/xbulk.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xhuge:	$Otest/xhuge.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xpool:	$Otest/xpool.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xcall:	$Otest/xcall.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xlive:	$Otest/xlive.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xrcon:	$Otest/xrcon.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xpack:	$Otest/xpack.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xstat:	$Otest/xstat.o $Otest/common.o ${LIBA} | $Otest/extstat
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/extstat:	$Otest/extstat.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xsplc:	$Otest/xsplc.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xcork:	$Otest/xcork.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xprio:	$Otest/xprio.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xauth:	$Otest/xauth.o $Otest/common.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xcapt:	$Otest/xcapt.o $Otest/common.o ${LIBA} | $Otest/extreplay
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/extreplay:	$Otest/extreplay.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
 $Otest/ipcom:	$Otest/ipcom.o $Otest/ping.o ${LIBA} | $Otest/ipcomsrv
 	@echo "Linking $@ ..."
 	@${CC} ${LDFLAGS} -o $@ $^
@@ -41,12 +109,28 @@ $Otest/ipcomsrv:	$Otest/ipcomsrv.o $Otest/ping.o ${LIBA}
 	@echo "Linking $@ ..."
 	@${CC} ${LDFLAGS} -o $@ $^
 
+$Otest/xbrok:	$Otest/xbrok.o $Otest/ping.o $Otest/common.o ${LIBA} | $Otest/brokerd
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/brokerd:	$Otest/brokerd.o $Otest/ping.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xbench:	$Otest/xbench.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
+$Otest/xstorm:	$Otest/xstorm.o ${LIBA}
+	@echo "Linking $@ ..."
+	@${CC} ${LDFLAGS} -o $@ $^
+
 ################ Maintenance ###########################################
 
 clean:	test/clean
 test/clean:
 	@if [ -d $Otest ]; then\
-	    rm -f ${test/TESTS} $Otest/ipcomsrv ${test/OBJS} ${test/DEPS} ${test/OUTS} $Otest/.d;\
+	    rm -f ${test/TESTS} $Otest/ipcomsrv $Otest/brokerd $Otest/extstat $Otest/extreplay $Otest/xbench $Otest/xstorm ${test/OBJS} ${test/DEPS} ${test/OUTS} $Otest/.d;\
 	    rmdir ${BUILDDIR}/test;\
 	fi
 
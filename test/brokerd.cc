@@ -0,0 +1,65 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "ping.h"
+#include "../xcom.h"
+
+//----------------------------------------------------------------------
+// brokerd illustrates the broker daemon. Servers register with it the
+// interfaces they serve, and clients find them through it. xbrok is
+// the test using it.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override
+			    { return PExternR::Dispatch (this, msg) || App::Dispatch (msg); }
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo*) noexcept {}
+private:
+			TestApp (void) : App(), _eserver (mrid_App) {}
+private:
+    PExternServer	_eserver;
+};
+
+// The broker relays calls to the interfaces it knows, so these must be
+// registered as extern msgers, including the reply interfaces. Others
+// can only be connected to directly.
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (ExternBroker, ExternBroker)
+    REGISTER_MSGER (ExternServer, ExternServer)
+    REGISTER_EXTERN_MSGER (Ping)
+    REGISTER_EXTERN_MSGER (PingR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+//----------------------------------------------------------------------
+
+void TestApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    bool isActivated = false;
+    for (int opt; 0 < (opt = getopt (argc, argv, "sd"));) {
+	if (opt == 's')
+	    isActivated = true;
+	#ifndef NDEBUG
+	    else if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+	#endif
+	else {
+	    printf ("Usage: brokerd [-s]\n"
+		    #ifndef NDEBUG
+			"  -d\tenable debug tracing\n"
+		    #endif
+		    "  -s\tlisten on the socket on stdin\n");
+	    exit (EXIT_SUCCESS);
+	}
+    }
+    // Clients of the broker see the broker interface and the relayed ones
+    static const iid_t eil_Broker[] = { PExternBroker::Interface(), PPing::Interface(), nullptr };
+    if (isActivated)
+	_eserver.Open (STDIN_FILENO, eil_Broker, PExternServer::WhenEmpty::Remain);
+    else if (0 > _eserver.BindBroker (eil_Broker))
+	return ErrorLibc ("BindBroker");
+}
@@ -0,0 +1,60 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <sys/un.h>
+#include <spawn.h>
+#include <fcntl.h>
+
+DEFINE_INTERFACE (Echo)
+DEFINE_INTERFACE (EchoR)
+DEFINE_INTERFACE (Data)
+DEFINE_INTERFACE (DataR)
+DEFINE_INTERFACE (Calc)
+DEFINE_INTERFACE (CalcR)
+DEFINE_INTERFACE (Proc)
+DEFINE_INTERFACE (ProcR)
+
+pid_t ForkServer (PExtern::fd_t& fd, int socktype) noexcept
+{
+    int socks[2];
+    if (0 > socketpair (PF_LOCAL, socktype| SOCK_NONBLOCK| SOCK_CLOEXEC, 0, socks))
+	return -1;
+    auto pid = fork();
+    if (pid < 0) {
+	close (socks[0]);
+	close (socks[1]);
+	return pid;
+    }
+    fd = socks[!pid];	// the child gets the second
+    close (socks[!!pid]);
+    return pid;
+}
+
+pid_t SpawnServer (const char* exe, const char* path, int socktype) noexcept
+{
+    sockaddr_un addr = {};
+    addr.sun_family = PF_LOCAL;
+    snprintf (ArrayBlock(addr.sun_path), "%s", path);
+    unlink (addr.sun_path);
+    auto fd = socket (PF_LOCAL, socktype| SOCK_NONBLOCK| SOCK_CLOEXEC, 0);
+    if (fd < 0)
+	return -1;
+    pid_t pid = -1;
+    if (0 <= bind (fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) && 0 <= listen (fd, SOMAXCONN)) {
+	posix_spawn_file_actions_t fa;
+	posix_spawn_file_actions_init (&fa);
+	posix_spawn_file_actions_adddup2 (&fa, fd, STDIN_FILENO);
+	posix_spawn_file_actions_addopen (&fa, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	char* argv[] = { const_cast<char*>(exe), const_cast<char*>("-s"), nullptr };
+	if (auto r = posix_spawnp (&pid, exe, &fa, nullptr, argv, environ); r) {
+	    errno = r;
+	    pid = -1;
+	}
+	posix_spawn_file_actions_destroy (&fa);
+    }
+    close (fd);	// only the server listens
+    return pid;
+}
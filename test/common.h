@@ -0,0 +1,195 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "../xcom.h"
+using namespace cwiclo;
+
+#define LOG(...)	do {printf(__VA_ARGS__);fflush(stdout);} while(false)
+
+//----------------------------------------------------------------------
+// Interfaces shared by the Extern tests. Each is served by a copy of
+// the test process, and so is called through a COMRelay, which Connect
+// creates explicitly, since the interface is also implemented locally.
+
+class PEcho : public Proxy {
+    DECLARE_INTERFACE (Echo, (Echo,"u"))
+public:
+    explicit	PEcho (mrid_t caller)	: Proxy (caller) {}
+    void	Connect (void)		{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Echo (uint32_t v)	{ Send (M_Echo(), v); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Echo())
+	    return false;
+	o->Echo_Echo (msg.Read().readv<uint32_t>());
+	return true;
+    }
+};
+
+class PEchoR : public ProxyR {
+    DECLARE_INTERFACE (EchoR, (Reply,"u"))
+public:
+    explicit	PEchoR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Reply (uint32_t v)		{ Send (M_Reply(), v); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Reply())
+	    return false;
+	o->EchoR_Reply (msg.Read().readv<uint32_t>());
+	return true;
+    }
+};
+
+// Replies with the size of the received data
+class PData : public Proxy {
+    DECLARE_INTERFACE (Data, (Put,"ay"))
+public:
+    explicit	PData (mrid_t caller)	: Proxy (caller) {}
+    void	Connect (void)		{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Put (const cmemlink& data)	{ Send (M_Put(), data); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Put())
+	    return false;
+	auto is = msg.Read();
+	cmemlink data; data.link_read (is);
+	o->Data_Put (data);
+	return true;
+    }
+};
+
+class PDataR : public ProxyR {
+    DECLARE_INTERFACE (DataR, (Received,"u"))
+public:
+    explicit	PDataR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Received (uint32_t sz)		{ Send (M_Received(), sz); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Received())
+	    return false;
+	o->DataR_Received (msg.Read().readv<uint32_t>());
+	return true;
+    }
+};
+
+// Hang is never replied to, for testing timeouts
+class PCalc : public Proxy {
+    DECLARE_INTERFACE (Calc, (Square,"u")(Hang,""))
+public:
+    explicit	PCalc (mrid_t caller)	: Proxy (caller) {}
+    void	Connect (void)		{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Square (uint32_t v)	{ Send (M_Square(), v); }
+    void	Hang (void)		{ Send (M_Hang()); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() == M_Square())
+	    o->Calc_Square (msg.Read().readv<uint32_t>());
+	else if (msg.Method() == M_Hang())
+	    o->Calc_Hang();
+	else
+	    return false;
+	return true;
+    }
+};
+
+class PCalcR : public ProxyR {
+    DECLARE_INTERFACE (CalcR, (Result,"u"))
+public:
+    explicit	PCalcR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Result (uint32_t v)		{ Send (M_Result(), v); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Result())
+	    return false;
+	o->CalcR_Result (msg.Read().readv<uint32_t>());
+	return true;
+    }
+};
+
+// Replies with the pid of the serving process
+class PProc : public Proxy {
+    DECLARE_INTERFACE (Proc, (Pid,""))
+public:
+    explicit	PProc (mrid_t caller)	: Proxy (caller) {}
+    void	Connect (void)	{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Pid (void)	{ Send (M_Pid()); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Pid())
+	    return false;
+	o->Proc_Pid();
+	return true;
+    }
+};
+
+class PProcR : public ProxyR {
+    DECLARE_INTERFACE (ProcR, (Pid,"i"))
+public:
+    explicit	PProcR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Pid (int32_t pid)		{ Send (M_Pid(), pid); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Pid())
+	    return false;
+	o->ProcR_Pid (msg.Read().readv<int32_t>());
+	return true;
+    }
+};
+
+//----------------------------------------------------------------------
+
+class EchoMsger : public Msger {
+public:
+    explicit	EchoMsger (const Msg::Link& l)	: Msger(l),_reply(l) {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PEcho::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    inline void	Echo_Echo (uint32_t v)	{ _reply.Reply (v); }
+private:
+    PEchoR	_reply;
+};
+
+class DataMsger : public Msger {
+public:
+    explicit	DataMsger (const Msg::Link& l)	: Msger(l),_reply(l) {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PData::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    inline void	Data_Put (const cmemlink& data)	{ _reply.Received (data.size()); }
+private:
+    PDataR	_reply;
+};
+
+class CalcMsger : public Msger {
+public:
+    explicit	CalcMsger (const Msg::Link& l)	: Msger(l),_reply(l) {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PCalc::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    // Replies sent here get the request id of the message dispatched
+    inline void	Calc_Square (uint32_t v)	{ _reply.Result (v*v); }
+    inline void	Calc_Hang (void)		{ }
+private:
+    PCalcR	_reply;
+};
+
+class ProcMsger : public Msger {
+public:
+    explicit	ProcMsger (const Msg::Link& l)	: Msger(l),_reply(l) {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PProc::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    inline void	Proc_Pid (void)	{ _reply.Pid (getpid()); }
+private:
+    PProcR	_reply;
+};
+
+//----------------------------------------------------------------------
+// Server processes
+
+// Forks a copy of this process, connected by a socketpair of socktype.
+// Returns the child's pid, 0 in the child, or -1 on failure, with fd
+// set to this process' end of the socket.
+pid_t ForkServer (PExtern::fd_t& fd, int socktype = SOCK_STREAM) noexcept;
+
+// Runs exe -s with a socket of socktype, listening on path, on its
+// stdin. The server's output is discarded.
+pid_t SpawnServer (const char* exe, const char* path, int socktype = SOCK_STREAM) noexcept;
@@ -0,0 +1,301 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "../xcom.h"
+#include <sys/un.h>
+#include <time.h>
+using namespace cwiclo;
+
+//----------------------------------------------------------------------
+// extreplay sends messages captured with PExtern::Capture to a server
+// on a UNIX socket, at the original speed, or with -f as fast as
+// possible. Each message is sent with a new request id, so that replies
+// can be matched to it, and the throughput and reply latency percentiles
+// are reported when all requests are answered, or no more replies arrive.
+// Messages to the link itself, and messages passing fds, belong to the
+// captured connection, and are skipped.
+
+static uint64_t NowUs (void)
+{
+    timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec*UINT64_C(1000000) + t.tv_nsec/1000;
+}
+
+class TestApp : public App {
+public:
+    using FrameHeader = Extern::FrameHeader;
+    using CaptureRecord = PExtern::CaptureRecord;
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PTimerR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		TimerR_Timer (PTimer::fd_t fd) noexcept;
+private:
+			TestApp (void) noexcept;
+    bool		ValidCapture (void) const noexcept;
+    void		QueueExport (void) noexcept;
+    void		QueueFrame (const FrameHeader& h, const char* f) noexcept;
+    void		QueueDue (uint64_t now) noexcept;
+    bool		WriteQueued (void) noexcept;
+    bool		ReadReplies (uint64_t now) noexcept;
+    void		Report (uint64_t now) noexcept;
+private:
+    enum : streamsize { c_MaxQueued = 64*1024 };
+    enum : PTimer::mstime_t { c_IdleTimeout = 1000 };
+    PTimer		_timer;
+    PTimer::fd_t	_sockfd;
+    bool		_fast;
+    memblock		_cap;		// the capture file
+    streamsize		_capp;		// offset of the next record
+    uint64_t		_due;		// of the next record
+    memblock		_obuf;		// frames to write
+    streamsize		_obufp;		// written offset in _obuf
+    memblock		_ibuf;		// received replies
+    vector<uint64_t>	_senttime;	// by request id-1
+    vector<uint64_t>	_latency;	// of each reply, in microseconds
+    uint64_t		_starttime;
+    uint64_t		_lastheard;
+    streamsize		_bytessent;
+    unsigned		_nskipped;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Timer, App::Timer)
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_timer (mrid_App)
+,_sockfd (-1)
+,_fast()
+,_cap()
+,_capp()
+,_due()
+,_obuf()
+,_obufp()
+,_ibuf()
+,_senttime()
+,_latency()
+,_starttime()
+,_lastheard()
+,_bytessent()
+,_nskipped()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    for (int opt; 0 < (opt = getopt (argc, argv, "f"));) {
+	if (opt == 'f')
+	    _fast = true;
+	else {
+	    optind = argc;	// to print usage
+	    break;
+	}
+    }
+    if (optind+2 != argc) {
+	printf ("Usage: extreplay [-f] <capture> <socket>\n");
+	exit (EXIT_SUCCESS);
+    }
+    if (0 > _cap.read_file (argv[optind]))
+	return ErrorLibc ("read capture");
+    if (!ValidCapture())
+	return Error ("%s is not a valid capture", argv[optind]);
+
+    sockaddr_un addr = {};
+    addr.sun_family = PF_LOCAL;
+    if (sizeof(addr.sun_path) <= strlen (argv[optind+1]))
+	return Error ("socket path is too long");
+    strcpy (addr.sun_path, argv[optind+1]);
+    _sockfd = PExtern::ConnectSocket (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    if (_sockfd < 0)
+	return ErrorLibc ("connect");
+
+    _starttime = _lastheard = _due = NowUs();
+    QueueExport();
+    TimerR_Timer (_sockfd);
+}
+
+bool TestApp::ValidCapture (void) const noexcept
+{
+    for (streamsize p = 0; p < _cap.size();) {
+	CaptureRecord r;
+	FrameHeader h;
+	if (_cap.size()-p < sizeof(r)+sizeof(h))
+	    return false;
+	copy_n (_cap.iat(p), sizeof(r), reinterpret_cast<char*>(&r));
+	copy_n (_cap.iat(p+sizeof(r)), sizeof(h), reinterpret_cast<char*>(&h));
+	if (_cap.size()-p-sizeof(r) < r.size || r.size != streamsize(h.hsz)+h.sz || h.hsz < sizeof(h))
+	    return false;
+	p += sizeof(r)+r.size;
+    }
+    return true;
+}
+
+// Instead of the captured handshake, an empty interface list is sent,
+// offering neither compression nor shared memory. The extended header
+// is offered, for the server to accept request ids.
+void TestApp::QueueExport (void) noexcept
+{
+    static const char c_ExportStrings[] = "COM\0Export\0s";
+    static const char c_ExportList[] = "@ext";
+    const uint32_t elsz = sizeof(c_ExportList);
+    FrameHeader h = {};
+    h.sz = Align (sizeof(elsz)+Align (elsz, sizeof(elsz)), Msg::Alignment::Body);
+    h.extid = Extern::c_FrameExtidCOM;
+    h.fdoffset = Msg::NoFdIncluded;
+    h.hsz = Align (sizeof(h)+sizeof(c_ExportStrings), Msg::Alignment::Header);
+    _obuf.append (reinterpret_cast<const char*>(&h), sizeof(h));
+    _obuf.append (c_ExportStrings, sizeof(c_ExportStrings));
+    auto padsz = h.hsz-sizeof(h)-sizeof(c_ExportStrings);
+    fill_n (_obuf.insert (_obuf.end(), padsz), padsz, 0);
+    _obuf.append (reinterpret_cast<const char*>(&elsz), sizeof(elsz));
+    _obuf.append (c_ExportList, elsz);
+    padsz = h.sz-sizeof(elsz)-elsz;
+    fill_n (_obuf.insert (_obuf.end(), padsz), padsz, 0);
+}
+
+// Queues the frame f with the next request id, replacing its own
+// request id, if it has one, and inserting it after the fixed header
+// if not.
+void TestApp::QueueFrame (const FrameHeader& h, const char* f) noexcept
+{
+    auto hstr = f+sizeof(h), hstre = f+h.hsz;
+    if (h.flags & Extern::c_FrameRequestIdFlag)
+	hstr += sizeof(Msg::reqid_t);
+    auto strse = hstr;	// after interface, method, and signature strings
+    auto nstrs = 0u;
+    for (unsigned n = hstre-hstr; nstrs < 3 && n; ++nstrs)
+	strse = strnext_r (strse, n);
+    auto nh = h;
+    nh.flags |= Extern::c_FrameRequestIdFlag;
+    auto nhsz = Align (sizeof(h)+sizeof(Msg::reqid_t)+(strse-hstr), Msg::Alignment::Header);
+    if (nstrs < 3 || nhsz > UINT8_MAX) {
+	++_nskipped;
+	return;
+    }
+    nh.hsz = nhsz;
+    Msg::reqid_t reqid = _senttime.size()+1;
+    _senttime.push_back (NowUs());
+    _obuf.append (reinterpret_cast<const char*>(&nh), sizeof(nh));
+    _obuf.append (reinterpret_cast<const char*>(&reqid), sizeof(reqid));
+    _obuf.append (hstr, strse-hstr);
+    auto padsz = nhsz-sizeof(nh)-sizeof(reqid)-(strse-hstr);
+    fill_n (_obuf.insert (_obuf.end(), padsz), padsz, 0);
+    _obuf.append (hstre, h.sz);
+}
+
+// Queues captured frames due by now, or all that fit with -f
+void TestApp::QueueDue (uint64_t now) noexcept
+{
+    while (_capp < _cap.size() && _obuf.size()-_obufp < c_MaxQueued) {
+	CaptureRecord r;
+	FrameHeader h;
+	copy_n (_cap.iat(_capp), sizeof(r), reinterpret_cast<char*>(&r));
+	copy_n (_cap.iat(_capp+sizeof(r)), sizeof(h), reinterpret_cast<char*>(&h));
+	if (!_fast && _due + r.delay > now)
+	    break;
+	_due += r.delay;
+	if (h.extid == Extern::c_FrameExtidCOM || h.fdoffset != Msg::NoFdIncluded)
+	    ++_nskipped;
+	else
+	    QueueFrame (h, _cap.iat(_capp+sizeof(r)));
+	_capp += sizeof(r)+r.size;
+    }
+}
+
+// Returns true if the socket is full
+bool TestApp::WriteQueued (void) noexcept
+{
+    while (_obufp < _obuf.size()) {
+	auto bw = write (_sockfd, _obuf.iat(_obufp), _obuf.size()-_obufp);
+	if (bw < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN)
+		return true;
+	    ErrorLibc ("write");
+	    return false;
+	}
+	_obufp += bw;
+	_bytessent += bw;
+    }
+    _obuf.clear();
+    _obufp = 0;
+    return false;
+}
+
+// Returns false if the server closed the connection
+bool TestApp::ReadReplies (uint64_t now) noexcept
+{
+    auto open = true;
+    for (;;) {
+	char buf [16*1024];
+	auto br = read (_sockfd, buf, sizeof(buf));
+	if (br < 0 && errno == EINTR)
+	    continue;
+	if (br <= 0) {
+	    open = br < 0 && errno == EAGAIN;
+	    break;
+	}
+	_ibuf.append (buf, br);
+	_lastheard = now;
+    }
+    streamsize p = 0;
+    for (FrameHeader h; _ibuf.size()-p >= sizeof(h); p += h.hsz+h.sz) {
+	copy_n (_ibuf.iat(p), sizeof(h), reinterpret_cast<char*>(&h));
+	if (_ibuf.size()-p < streamsize(h.hsz)+h.sz)
+	    break;
+	if (!(h.flags & Extern::c_FrameRequestIdFlag) || h.hsz < sizeof(h)+sizeof(Msg::reqid_t))
+	    continue;
+	Msg::reqid_t reqid;
+	copy_n (_ibuf.iat(p+sizeof(h)), sizeof(reqid), reinterpret_cast<char*>(&reqid));
+	if (reqid != Msg::NoRequest && reqid <= _senttime.size() && _senttime[reqid-1]) {
+	    _latency.push_back (now - _senttime[reqid-1]);
+	    _senttime[reqid-1] = 0;	// only the first reply is counted
+	}
+    }
+    _ibuf.erase (_ibuf.begin(), p);
+    return open;
+}
+
+void TestApp::TimerR_Timer (PTimer::fd_t) noexcept
+{
+    auto now = NowUs();
+    auto open = ReadReplies (now);
+    QueueDue (now);
+    auto full = open && WriteQueued();
+    auto sent = _capp >= _cap.size() && _obuf.empty();
+    if (!open || (sent && _latency.size() == _senttime.size())
+	    || (sent && now - _lastheard >= c_IdleTimeout*1000))
+	return Report (now);
+
+    PTimer::mstime_t timeout = c_IdleTimeout;
+    if (!sent && !full && !_fast) {
+	CaptureRecord r;
+	copy_n (_cap.iat(_capp), sizeof(r), reinterpret_cast<char*>(&r));
+	timeout = (_due + r.delay - min (now, _due + r.delay) + 999)/1000;
+    }
+    _timer.Watch (full ? PTimer::WatchCmd::ReadWrite : PTimer::WatchCmd::Read, _sockfd, timeout);
+}
+
+void TestApp::Report (uint64_t now) noexcept
+{
+    auto elapsed = max (now - _starttime, uint64_t(1));
+    printf ("Replayed %u messages, skipped %u, in %.3f s\n", _senttime.size(), _nskipped, elapsed/1e6);
+    printf ("Throughput: %.0f messages/s, %.2f MB/s\n", _senttime.size()*1e6/elapsed, _bytessent/double(elapsed));
+    printf ("%u replies to %u requests\n", _latency.size(), _senttime.size());
+    if (!_latency.empty()) {
+	sort (_latency);
+	auto pct = [&](unsigned p) { return _latency[(_latency.size()-1)*p/100]; };
+	printf ("Latency, us: p50 %lu, p90 %lu, p99 %lu, max %lu\n", pct(50), pct(90), pct(99), _latency.back());
+    }
+    close (exchange (_sockfd, -1));
+    Quit();
+}
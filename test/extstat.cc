@@ -0,0 +1,82 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "../xcom.h"
+using namespace cwiclo;
+
+//----------------------------------------------------------------------
+// extstat dumps traffic statistics of the Extern connections of a live
+// process, which must export ExternStats on the given socket. A socket
+// name without a path is looked up in XDG_RUNTIME_DIR.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PExternStatsR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		ExternStatsR_Stats (const PExternStatsR::connections_t& conns) noexcept;
+private:
+			TestApp (void) noexcept : App(),_extern (mrid_App),_stats (mrid_App) {}
+private:
+    PExtern		_extern;
+    PExternStats	_stats;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_EXTERN_MSGER (ExternStats)
+    REGISTER_EXTERN_MSGER (ExternStatsR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+void TestApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    for (int opt; 0 < (opt = getopt (argc, argv, "d"));) {
+	#ifndef NDEBUG
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+	    else
+	#endif
+	{
+	    optind = argc;	// to print usage
+	    break;
+	}
+    }
+    if (optind+1 != argc) {
+	printf ("Usage: extstat [-d] <socket>\n");
+	exit (EXIT_SUCCESS);
+    }
+    auto sockname = argv[optind];
+    auto fd = strchr (sockname, '/') ? _extern.ConnectLocal (sockname) : _extern.ConnectUserLocal (sockname);
+    if (fd < 0)
+	return ErrorLibc ("connect");
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PExternStats::Interface()))
+	return Error ("the process does not export ExternStats");
+    _stats.Open();
+    _stats.Query();
+}
+
+void TestApp::ExternStatsR_Stats (const PExternStatsR::connections_t& conns) noexcept
+{
+    printf ("%5s %6s %7s %10s %10s %12s %12s %8s %8s %6s %6s %8s %8s\n",
+	    "id", "relays", "pid", "msgs in", "msgs out", "bytes in", "bytes out",
+	    "writes", "partial", "waits", "maxq", "avgq us", "maxq us");
+    for (auto& c : conns) {
+	auto& t = c.traffic;
+	printf ("%5hu %6hu %7d %10lu %10lu %12lu %12lu %8u %8u %6u %6u %8lu %8lu\n",
+		c.id, c.nrelays, c.peerpid, t.msgsIn, t.msgsOut, t.bytesIn, t.bytesOut,
+		t.writes, t.partialWrites, t.writeWaits, t.maxQueued,
+		t.msgsOut ? t.queueTime/t.msgsOut : 0, t.maxQueueTime);
+    }
+    Quit();
+}
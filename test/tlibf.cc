@@ -8,6 +8,8 @@
 #include "../multiset.h"
 #include "../string.h"
 #include "../stream.h"
+#include "../compress.h"
+#include "../msg.h"
 #include <ctype.h>
 #include <stdarg.h>
 using namespace cwiclo;
@@ -27,6 +29,8 @@ private:
     static void		TestString (void);
     static void		TestStringVector (void);
     static void		TestStreams (void);
+    static void		TestCompress (void);
+    static void		TestValidate (void);
     static void		WriteML (const memlink& l);
     static void		WriteMB (const memblock& l);
     static void		PrintVector (const vector<int>& v);
@@ -625,6 +629,112 @@ void LibTestApp::TestStreams (void) // static
 	putchar ('\n');
     }
 }
+//}}}-------------------------------------------------------------------
+//{{{ TestCompress
+
+static void TestCompressBlock (const char* name, const cmemlink& data)
+{
+    memblock cbuf (lz_compress_bound (data.size())), dbuf (data.size());
+    auto csz = lz_compress (data.data(), data.size(), cbuf.data(), cbuf.size());
+    auto dsz = lz_decompress (cbuf.data(), csz, dbuf.data(), dbuf.size());
+    printf ("%s: %u -> %u bytes, %s", name, data.size(), csz,
+	    dsz == data.size() && data == dbuf ? "ok" : "failed");
+    // Truncated or undersized decompression must fail without overrun
+    if (csz > 1 && lz_decompress (cbuf.data(), csz-1, dbuf.data(), dbuf.size()) == data.size())
+	printf (", truncated input accepted");
+    if (data.size() && lz_decompress (cbuf.data(), csz, dbuf.data(), data.size()-1))
+	printf (", overflow accepted");
+    // And compression into a buffer too small must fail too
+    if (csz > 1 && lz_compress (data.data(), data.size(), cbuf.data(), csz-1))
+	printf (", compressed into too small buffer");
+    printf ("\n");
+}
+
+void LibTestApp::TestCompress (void) // static
+{
+    TestCompressBlock ("empty", cmemlink());
+    static const char c_Short[] = "Hello world!";
+    TestCompressBlock ("short", cmemlink (c_Short, sizeof(c_Short)));
+
+    memblock data (64*1024);
+    fill (data.begin(), data.end(), 'x');
+    TestCompressBlock ("run", data);
+
+    for (auto i = 0u; i < data.size(); ++i)
+	data[i] = "The quick brown fox jumps over the lazy dog. "[i%45] ^ (i/4096);
+    TestCompressBlock ("text", data);
+
+    uint32_t r = 1;
+    for (auto& c : data)
+	c = (r = r*1103515245 + 12345) >> 24;
+    TestCompressBlock ("random", data);
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ TestValidate
+
+static void WriteTestString (ostream& os, const char* s, streamsize n)
+{
+    os << n;
+    os.write (s, n);
+    os.align (4);
+}
+
+static void TestValidateSig (const char* name, const char* sig, const memblock& body)
+{
+    istream is (body), sis (body);
+    auto sz = Msg::ValidateSignature (is, sig);
+    auto ssz = Msg::ValidateSignature (sis, sig, true);
+    printf ("%s: \"%s\" %u bytes, %s, strict %s\n", name, sig, body.size(),
+	    sz == body.size() ? "valid" : "invalid", ssz == body.size() ? "valid" : "invalid");
+}
+
+void LibTestApp::TestValidate (void) // static
+{
+    static const char* c_Strings[] = { "one", "", "three", "a longer string to cross the alignment" };
+    memblock body (256);
+    ostream os (body);
+    os << uint32_t(ArraySize(c_Strings));
+    for (auto s : c_Strings)
+	WriteTestString (os, s, strlen(s)+1);
+    body.resize (distance (body.data(), os.ptr<char>()));
+    TestValidateSig ("strings", "as", body);
+
+    auto truncated = body;
+    truncated.resize (truncated.size()-4);
+    TestValidateSig ("truncated", "as", truncated);
+
+    auto unterminated = body;
+    unterminated[4+4+3] = 'x';	// the zero after "one"
+    TestValidateSig ("unterminated", "as", unterminated);
+
+    body.resize (256);
+    ostream eos (body);
+    eos << uint32_t(2);
+    static const char c_Embedded[] = "embedded\0zero";
+    WriteTestString (eos, c_Embedded, sizeof(c_Embedded));
+    WriteTestString (eos, c_Strings[0], strlen(c_Strings[0])+1);
+    body.resize (distance (body.data(), eos.ptr<char>()));
+    TestValidateSig ("embedded", "as", body);
+
+    body.resize (256);
+    ostream sos (body);
+    WriteTestString (sos, c_Embedded, sizeof(c_Embedded));
+    sos << uint32_t(42);
+    body.resize (distance (body.data(), sos.ptr<char>()));
+    TestValidateSig ("struct", "(su)", body);
+
+    // A large string array, to exercise the bulk path
+    vector<char> item (1000, 'x');
+    item.back() = 0;
+    body.resize (4+1000*(4+1000));
+    ostream los (body);
+    los << uint32_t(1000);
+    for (auto i = 0u; i < 1000; ++i)
+	WriteTestString (los, item.data(), item.size());
+    TestValidateSig ("large", "as", body);
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ Run tests
 
@@ -639,7 +749,9 @@ int LibTestApp::Run (void)
 	TestMultiset,
 	TestString,
 	TestStringVector,
-	TestStreams
+	TestStreams,
+	TestCompress,
+	TestValidate
     };
     for (auto i = 0u; i < ArraySize(c_Tests); ++i) {
 	printf ("######################################################################\n");
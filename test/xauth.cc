@@ -0,0 +1,132 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+
+//----------------------------------------------------------------------
+// xauth tests access rules on exported interfaces. The server, a forked
+// copy of this process connected by socketpair, allows Echo to this
+// uid, Calc to this gid, and Proc only to another uid. Messages sent
+// to Proc must be denied, with the connection remaining usable.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PEchoR::Dispatch (this, msg)
+				|| PCalcR::Dispatch (this, msg)
+				|| PProcR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    void		OnMsgerDestroyed (mrid_t mid) noexcept override;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		EchoR_Reply (uint32_t v) noexcept;
+    inline void		CalcR_Result (uint32_t) noexcept	{ ++_nsquares; Report(); }
+    inline void		ProcR_Pid (int32_t) noexcept		{ ++_npids; Report(); }
+private:
+			TestApp (void) noexcept;
+    void		Report (void) noexcept;
+private:
+    enum : uint32_t { c_NCalls = 3, c_LastEcho = 100 };
+    PEcho		_echo;
+    PCalc		_calc;
+    PProc		_proc;
+    PExtern		_extern;
+    uint32_t		_nechoes;
+    uint32_t		_nsquares;
+    uint32_t		_npids;
+    bool		_denied;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Echo, EchoMsger)
+    REGISTER_MSGER (Calc, CalcMsger)
+    REGISTER_MSGER (Proc, ProcMsger)
+    REGISTER_EXTERN_MSGER (EchoR)
+    REGISTER_EXTERN_MSGER (CalcR)
+    REGISTER_EXTERN_MSGER (ProcR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_echo (mrid_App)
+,_calc (mrid_App)
+,_proc (mrid_App)
+,_extern (mrid_App)
+,_nechoes()
+,_nsquares()
+,_npids()
+,_denied()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd); pid < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!pid) {	// the child serves all three
+	Extern::Allow (PEcho::Interface(), getuid());
+	Extern::Allow (PCalc::Interface(), Extern::AnyId, getgid());
+	Extern::Allow (PProc::Interface(), getuid()+1);
+	static const iid_t eil_Served[] = { PEcho::Interface(), PCalc::Interface(), PProc::Interface(), nullptr };
+	return _extern.Open (fd, eil_Served, PExtern::SocketSide::Server);
+    }
+    _extern.Open (fd);
+}
+
+// Several messages are sent to Proc, each denied
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PEcho::Interface()))
+	return;	// the server side imports nothing
+    _echo.Connect();
+    _calc.Connect();
+    _proc.Connect();
+    for (auto i = 0u; i < c_NCalls; ++i) {
+	_echo.Echo (i);
+	_calc.Square (i);
+	_proc.Pid();
+    }
+}
+
+// The denied relay is deleted by the server
+void TestApp::OnMsgerDestroyed (mrid_t mid) noexcept
+{
+    App::OnMsgerDestroyed (mid);
+    if (mid != _proc.Dest())
+	return;
+    _denied = true;
+    Report();
+}
+
+void TestApp::EchoR_Reply (uint32_t v) noexcept
+{
+    if (v == c_LastEcho) {
+	LOG ("Connection kept after denial\n");
+	return Quit();
+    }
+    ++_nechoes;
+    Report();
+}
+
+// After all replies, the last echo is sent after the denials
+void TestApp::Report (void) noexcept
+{
+    if ((!_denied && _npids < c_NCalls) || _nechoes < c_NCalls || _nsquares < c_NCalls)
+	return;
+    LOG ("Access by uid allowed\n");
+    LOG ("Access by gid allowed\n");
+    LOG ("Access by another uid %s\n", _npids ? "allowed" : "denied");
+    _echo.Echo (c_LastEcho);
+}
@@ -0,0 +1,255 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "../xcom.h"
+#include "../compress.h"
+#include <sys/wait.h>
+#include <time.h>
+using namespace cwiclo;
+
+//----------------------------------------------------------------------
+// xbench measures Extern message throughput on a loopback TCP
+// connection and on a UNIX socket pair. Each run is done in a forked
+// client process, which forks the server process. Run with make bench;
+// not a make check test.
+
+class PBench : public Proxy {
+    DECLARE_INTERFACE (Bench, (Put,"ay")(Sync,""))
+public:
+    explicit	PBench (mrid_t caller) : Proxy (caller) {}
+    void	Put (const cmemlink& data)	{ Send (M_Put(), data); }
+    void	Sync (void)			{ Send (M_Sync()); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() == M_Put()) {
+	    auto is = msg.Read();
+	    cmemlink data; data.link_read (is);
+	    o->Bench_Put (data);
+	} else if (msg.Method() == M_Sync())
+	    o->Bench_Sync();
+	else
+	    return false;
+	return true;
+    }
+};
+
+class PBenchR : public ProxyR {
+    DECLARE_INTERFACE (BenchR, (Synced,"uu"))
+public:
+    explicit	PBenchR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Synced (uint32_t n, uint32_t sum)	{ Send (M_Synced(), n, sum); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Synced())
+	    return false;
+	auto is = msg.Read();
+	auto n = is.readv<uint32_t>();
+	auto sum = is.readv<uint32_t>();
+	o->BenchR_Synced (n, sum);
+	return true;
+    }
+};
+
+DEFINE_INTERFACE (Bench)
+DEFINE_INTERFACE (BenchR)
+
+static uint32_t Checksum (const cmemlink& data, uint32_t sum = 0)
+{
+    for (auto c : data)
+	sum = Rol (sum, 1u) ^ uint8_t(c);
+    return sum;
+}
+
+static uint64_t NowUs (void)
+{
+    timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec*UINT64_C(1000000) + t.tv_nsec/1000;
+}
+
+//----------------------------------------------------------------------
+
+class BenchMsger : public Msger {
+public:
+    explicit	BenchMsger (const Msg::Link& l)	: Msger(l),_reply(l),_n(),_sum() {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PBench::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    inline void	Bench_Put (const cmemlink& data)	{ ++_n; _sum = Checksum (data, _sum); }
+    inline void	Bench_Sync (void)			{ _reply.Synced (_n, _sum); }
+private:
+    PBenchR	_reply;
+    uint32_t	_n;
+    uint32_t	_sum;
+};
+
+//----------------------------------------------------------------------
+
+class BenchApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static BenchApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PBenchR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		BenchR_Synced (uint32_t n, uint32_t sum) noexcept;
+private:
+			BenchApp (void) noexcept;
+    struct Mode {
+	const char*		name;
+	int			family;
+	PExtern::Compression	compression;
+	PExtern::Transport	transport;
+    };
+    void		RunClient (const Mode& mode) noexcept;
+private:
+    PBench		_bench;
+    PExtern		_extern;
+    memblock		_payload;
+    uint64_t		_starttime;
+    unsigned		_nmsgs;
+    const char*		_modename;
+};
+
+BEGIN_CWICLO_APP (BenchApp)
+    REGISTER_MSGER (Bench, BenchMsger)
+    REGISTER_EXTERN_MSGER (BenchR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+BenchApp::BenchApp (void) noexcept
+: App()
+,_bench (mrid_App)
+,_extern (mrid_App)
+,_payload()
+,_starttime()
+,_nmsgs (4096)
+,_modename()
+{
+}
+
+void BenchApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    unsigned msgsz = 16*1024;
+    for (int opt; 0 < (opt = getopt (argc, argv, "n:s:"));) {
+	if (opt == 'n')
+	    _nmsgs = atoi (optarg);
+	else if (opt == 's')
+	    msgsz = atoi (optarg);
+	else {
+	    printf ("Usage: xbench [-n count] [-s size]\n"
+		    "  -n\tnumber of messages to send\n"
+		    "  -s\tmessage payload size\n");
+	    exit (EXIT_SUCCESS);
+	}
+    }
+
+    // The payload is repetitive marshalled data, as in a list of records
+    _payload.reserve (msgsz);
+    for (auto i = 0u; _payload.size() < msgsz; ++i) {
+	char name [32], rec [64];
+	auto namesz = snprintf (ArrayBlock(name), "sensor.%u.temperature", i%64)+1;
+	ostream os (ArrayBlock(rec));
+	os << i << uint32_t(namesz);
+	os.write (name, namesz);
+	os.align (8);
+	os << uint64_t(1500000000+i*10) << uint32_t(i%7 ? 0 : 1) << uint32_t(200+i%50);
+	auto recsz = distance (rec, os.ptr<char>());
+	_payload.resize (_payload.size()+recsz);
+	copy_n (rec, recsz, _payload.iat (_payload.size()-recsz));
+    }
+    _payload.resize (msgsz);
+
+    static const Mode c_Modes[] = {
+	{ "tcp",	PF_INET,  PExtern::Compression::Off,  PExtern::Transport::Auto },
+	{ "tcp+lz",	PF_INET,  PExtern::Compression::On,   PExtern::Transport::Auto },
+	{ "unix",	PF_LOCAL, PExtern::Compression::Auto, PExtern::Transport::Socket },
+	{ "unix+shm",	PF_LOCAL, PExtern::Compression::Auto, PExtern::Transport::Auto }
+    };
+    for (auto& m : c_Modes) {
+	if (auto pid = fork(); pid < 0)
+	    return ErrorLibc ("fork");
+	else if (!pid) {
+	    _modename = m.name;
+	    return RunClient (m);
+	} else
+	    waitpid (pid, nullptr, 0);
+    }
+    exit (EXIT_SUCCESS);
+}
+
+void BenchApp::RunClient (const Mode& mode) noexcept
+{
+    static const iid_t eil_Bench[] = { PBench::Interface(), nullptr };
+    if (mode.family == PF_LOCAL) {
+	int socks[2];
+	if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK| SOCK_CLOEXEC, 0, socks))
+	    return ErrorLibc ("socketpair");
+	if (auto pid = fork(); pid < 0)
+	    return ErrorLibc ("fork");
+	else if (!pid) {
+	    close (socks[0]);
+	    return _extern.Open (socks[1], eil_Bench, PExtern::SocketSide::Server, mode.compression, mode.transport);
+	}
+	close (socks[1]);
+	return _extern.Open (socks[0], nullptr, PExtern::SocketSide::Client, mode.compression, mode.transport);
+    }
+
+    // Listen on a loopback port selected by the kernel
+    sockaddr_in addr = {};
+    addr.sin_family = PF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    auto lfd = socket (PF_INET, SOCK_STREAM| SOCK_CLOEXEC, IPPROTO_IP);
+    if (lfd < 0 || 0 > bind (lfd, reinterpret_cast<const sockaddr*>(&addr), addrlen)
+	    || 0 > listen (lfd, 1)
+	    || 0 > getsockname (lfd, reinterpret_cast<sockaddr*>(&addr), &addrlen))
+	return ErrorLibc ("listen");
+
+    if (auto pid = fork(); pid < 0)
+	return ErrorLibc ("fork");
+    else if (!pid) {	// the server accepts one connection and serves Bench on it
+	auto cfd = accept (lfd, nullptr, nullptr);
+	close (lfd);
+	if (cfd < 0)
+	    return ErrorLibc ("accept");
+	return _extern.Open (cfd, eil_Bench, PExtern::SocketSide::Server, mode.compression, mode.transport);
+    }
+    close (lfd);
+    auto fd = socket (PF_INET, SOCK_STREAM| SOCK_CLOEXEC, IPPROTO_IP);
+    if (fd < 0 || 0 > connect (fd, reinterpret_cast<const sockaddr*>(&addr), addrlen))
+	return ErrorLibc ("connect");
+    _extern.Open (fd, nullptr, PExtern::SocketSide::Client, mode.compression, mode.transport);
+}
+
+void BenchApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PBench::Interface()))
+	return;
+    _bench.CreateDestWith (PBench::Interface(), &Msger::Factory<COMRelay>);
+    _starttime = NowUs();
+    for (auto i = 0u; i < _nmsgs; ++i)
+	_bench.Put (_payload);
+    _bench.Sync();
+}
+
+void BenchApp::BenchR_Synced (uint32_t n, uint32_t sum) noexcept
+{
+    auto elapsed = NowUs() - _starttime;
+    uint32_t esum = 0;
+    for (auto i = 0u; i < _nmsgs; ++i)
+	esum = Checksum (_payload, esum);
+
+    memblock cbuf (lz_compress_bound (_payload.size()));
+    auto csz = lz_compress (_payload.data(), _payload.size(), cbuf.data(), cbuf.size());
+
+    auto mb = double(_nmsgs)*_payload.size()/(1024*1024);
+    printf ("%-8s %u x %u bytes in %.1f ms, %.1f MB/s, payload ratio %.1f%%%s\n",
+	    _modename, n, _payload.size(), elapsed/1000., mb*1000000/max(elapsed,uint64_t(1)),
+	    100.*csz/_payload.size(), (n == _nmsgs && sum == esum) ? "" : ", CORRUPTED");
+    Quit();
+}
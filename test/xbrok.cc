@@ -0,0 +1,174 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "ping.h"
+#include "common.h"
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <paths.h>
+
+//----------------------------------------------------------------------
+// xbrok tests finding a server through the broker daemon, brokerd.
+// The server is a copy of this process, run with -s to serve Ping on
+// the listening socket on stdin, and to register it with the broker.
+// The client pings the server through its connection to the broker,
+// and then directly, on the connection made by the broker. The server
+// listens on a SOCK_SEQPACKET socket, which the broker must connect to
+// with the same type.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PPingR::Dispatch (this, msg)
+				|| PExternBrokerR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		OnMsgerDestroyed (mrid_t mid) noexcept override;
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		ExternBrokerR_Connection (PExternBroker::fd_t fd, iid_t iface) noexcept;
+    inline void		PingR_Ping (uint32_t v) noexcept;
+private:
+			TestApp (void) noexcept;
+			~TestApp (void) noexcept override;
+    void		Cleanup (void) noexcept;
+private:
+    enum { c_Multiplexed = 1, c_Direct };
+    PExtern		_extern;	// to the broker
+    PExtern		_direct;
+    PExternServer	_eserver;
+    PExternBroker	_broker;
+    PPing		_mping;
+    PPing		_dping;
+    PExternBroker::fd_t	_directfd;
+    pid_t		_brokerd;
+    pid_t		_server;
+    char		_dir [32];
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Ping, PingMsger)
+    REGISTER_MSGER (ExternServer, ExternServer)
+    REGISTER_EXTERN_MSGER (PingR)
+    REGISTER_EXTERN_MSGER (ExternBroker)
+    REGISTER_EXTERN_MSGER (ExternBrokerR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_extern (mrid_App)
+,_direct (mrid_App)
+,_eserver (mrid_App)
+,_broker (mrid_App)
+,_mping (mrid_App)
+,_dping (mrid_App)
+,_directfd (-1)
+,_brokerd()
+,_server()
+,_dir()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    for (int opt; 0 < (opt = getopt (argc, argv, "ds"));) {
+	if (opt == 's') {	// serve Ping on the listening socket on stdin
+	    static const iid_t eil_Ping[] = { PPing::Interface(), nullptr };
+	    _eserver.Open (STDIN_FILENO, eil_Ping, PExternServer::WhenEmpty::Remain);
+	    if (0 > _extern.ConnectBroker())
+		ErrorLibc ("ConnectBroker");
+	    return;
+	}
+	#ifndef NDEBUG
+	    else if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+	#endif
+    }
+    // The broker socket is found in XDG_RUNTIME_DIR
+    snprintf (ArrayBlock(_dir), "%s/xbrok.XXXXXX", _PATH_TMP);
+    if (!mkdtemp (_dir))
+	return ErrorLibc ("mkdtemp");
+    setenv ("XDG_RUNTIME_DIR", _dir, true);
+    // The listening sockets are created here, as with socket activation,
+    // so that connecting to them does not wait for the servers to start.
+    char brokerpath [sizeof(sockaddr_un::sun_path)], pingpath [sizeof(sockaddr_un::sun_path)];
+    snprintf (ArrayBlock(brokerpath), "%s/%s", _dir, PExternBroker::c_SocketName);
+    snprintf (ArrayBlock(pingpath), "%s/ping.socket", _dir);
+    if (0 > (_brokerd = SpawnServer ("brokerd", brokerpath))
+	    || 0 > (_server = SpawnServer ("xbrok", pingpath, SOCK_SEQPACKET)))
+	return ErrorLibc ("failed to start servers");
+    if (0 > _extern.ConnectBroker())
+	return ErrorLibc ("ConnectBroker");
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (einfo->IsImporting (PExternBroker::Interface())) {
+	_broker.Open();
+	if (_server)	// the client asks for a connection to the server
+	    _broker.Connect (PPing::Interface());
+	else {		// the server registers, with a copy of its listening socket
+	    static const iid_t eil_Ping[] = { PPing::Interface(), nullptr };
+	    _broker.Register (dup (STDIN_FILENO), eil_Ping);
+	}
+    } else if (einfo->IsImporting (PPing::Interface())) {
+	_dping.CreateDestWith (PPing::Interface(), &Msger::Factory<COMRelay>);
+	_dping.Ping (c_Direct);
+    }
+}
+
+void TestApp::ExternBrokerR_Connection (PExternBroker::fd_t fd, iid_t iface) noexcept
+{
+    LOG ("Broker connected to the %s server\n", iface);
+    _directfd = fd;
+    // Ping is also imported from the broker, which relays it to the server
+    _mping.CreateDestWith (PPing::Interface(), &Msger::Factory<COMRelay>);
+    _mping.Ping (c_Multiplexed);
+}
+
+void TestApp::PingR_Ping (uint32_t v) noexcept
+{
+    if (v == c_Multiplexed) {
+	LOG ("Multiplexed ping through the broker\n");
+	_extern.Close();	// and then open the direct connection
+    } else {
+	LOG ("Direct ping to the server\n");
+	Quit();
+    }
+}
+
+void TestApp::OnMsgerDestroyed (mrid_t mid) noexcept
+{
+    App::OnMsgerDestroyed (mid);
+    if (mid == _extern.Dest() && _directfd >= 0)
+	_direct.Open (exchange (_directfd, -1));
+}
+
+// The servers are stopped on exit, including on errors
+TestApp::~TestApp (void) noexcept
+{
+    if (_dir[0])
+	Cleanup();
+}
+
+void TestApp::Cleanup (void) noexcept
+{
+    for (auto pid : {_brokerd, _server}) {
+	if (pid <= 0)
+	    continue;
+	kill (pid, SIGKILL);
+	waitpid (pid, nullptr, 0);
+    }
+    char path [sizeof(sockaddr_un::sun_path)];
+    for (auto sockname : {PExternBroker::c_SocketName, "ping.socket"}) {
+	snprintf (ArrayBlock(path), "%s/%s", _dir, sockname);
+	unlink (path);
+    }
+    rmdir (_dir);
+}
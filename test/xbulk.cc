@@ -0,0 +1,297 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <sys/mman.h>
+
+//----------------------------------------------------------------------
+// xbulk tests sending large payloads through an Extern connection.
+// The server is a forked copy of this process, connected by socketpair.
+
+class PBlob : public Proxy {
+    DECLARE_INTERFACE (Blob, (Put,"ay")(PutFds,"ah"))
+public:
+    explicit	PBlob (mrid_t caller) : Proxy (caller) {}
+    // Messages to the remote object must go through a COMRelay. Since
+    // Blob here is also implemented locally, the relay is created explicitly.
+    void	Connect (void)	{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Put (const cmemlink& data, streamsize segsz = UINT32_MAX) {
+		    // The blob is linked as body segments instead of being
+		    // copied into the message. It must remain valid until
+		    // written to the socket. Data size must be a multiple
+		    // of 4 to keep the array padding in the body.
+		    assert (IsAligned (data.size(), 4));
+		    auto& msg = CreateMsg (M_Put(), sizeof(data.size()));
+		    auto os = msg.Write();
+		    os << data.size();
+		    for (streamsize o = 0; o < data.size(); o += segsz)
+			msg.AppendSegment (Msg::Segment (data.iat(o), min (segsz, data.size()-o)));
+		    CommitMsg (msg, os);
+		}
+    // Shared bodies are sent without copying, so the same
+    // payload can be sent to many objects at the cost of one.
+    void	Put (const Msg::SharedBody& data)	{ Send (M_Put(), data); }
+    // Several fds are passed as an fd array, with the fd offset
+    // pointing to its first element, after the element count.
+    void	PutFds (const PExtern::fd_t* fds, uint32_t nfds) {
+		    auto& msg = CreateMsg (M_PutFds(), sizeof(nfds)+nfds*sizeof(PExtern::fd_t), sizeof(nfds), nfds);
+		    auto os = msg.Write();
+		    os << nfds;
+		    for (auto i = 0u; i < nfds; ++i)
+			os << fds[i];
+		    CommitMsg (msg, os);
+		}
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	auto is = msg.Read();
+	if (msg.Method() == M_Put()) {
+	    cmemlink data; data.link_read (is);
+	    o->Blob_Put (data);
+	} else if (msg.Method() == M_PutFds()) {
+	    auto nfds = is.readv<uint32_t>();
+	    o->Blob_PutFds (is.ptr<PExtern::fd_t>(), nfds);
+	} else
+	    return false;
+	return true;
+    }
+};
+
+class PBlobR : public ProxyR {
+    DECLARE_INTERFACE (BlobR, (Received,"uu"))
+public:
+    explicit	PBlobR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Received (uint32_t sz, uint32_t sum)	{ Send (M_Received(), sz, sum); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Received())
+	    return false;
+	auto is = msg.Read();
+	auto sz = is.readv<uint32_t>();
+	auto sum = is.readv<uint32_t>();
+	o->BlobR_Received (sz, sum);
+	return true;
+    }
+};
+
+DEFINE_INTERFACE (Blob)
+DEFINE_INTERFACE (BlobR)
+
+static uint32_t Checksum (const cmemlink& data, uint32_t sum = 0)
+{
+    for (auto c : data)
+	sum = Rol (sum, 1u) ^ uint8_t(c);
+    return sum;
+}
+
+//----------------------------------------------------------------------
+
+class BlobMsger : public Msger {
+public:
+    explicit	BlobMsger (const Msg::Link& l)	: Msger(l),_reply(l),_ack(l),_size(),_sum() {}
+    bool	Dispatch (Msg& msg) noexcept override {
+		    return PBlob::Dispatch (this, msg)
+			|| PTransfer::Dispatch (this, msg)
+			|| Msger::Dispatch (msg);
+		}
+    inline void	Blob_Put (const cmemlink& data)	{ _reply.Received (data.size(), Checksum (data)); }
+    void	Blob_PutFds (const PExtern::fd_t* fds, uint32_t nfds) noexcept;
+    inline void	Transfer_Open (uint64_t)	{ _size = 0; _sum = 0; }
+    inline void	Transfer_Data (const cmemlink& chunk) {
+		    _size += chunk.size();
+		    _sum = Checksum (chunk, _sum);
+		    _ack.Ack (chunk.size());
+		}
+    inline void	Transfer_Close (void)		{ _reply.Received (_size, _sum); }
+private:
+    PBlobR	_reply;
+    PTransferR	_ack;
+    uint32_t	_size;
+    uint32_t	_sum;
+};
+
+// Each passed fd is a memfd containing a part of the blob
+void BlobMsger::Blob_PutFds (const PExtern::fd_t* fds, uint32_t nfds) noexcept
+{
+    uint32_t size = 0, sum = 0;
+    for (auto i = 0u; i < nfds; ++i) {
+	char buf [4096];
+	for (ssize_t br, o = 0; 0 < (br = pread (fds[i], buf, sizeof(buf), o)); o += br, size += br)
+	    sum = Checksum (cmemlink (buf, br), sum);
+	close (fds[i]);
+    }
+    _reply.Received (size, sum);
+}
+
+//----------------------------------------------------------------------
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PBlobR::Dispatch (this, msg)
+				|| PTransferR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		BlobR_Received (uint32_t sz, uint32_t sum) noexcept;
+    inline void		TransferR_Ack (uint32_t sz) noexcept;
+private:
+			TestApp (void) noexcept;
+    void		SendNext (void) noexcept;
+    void		WriteTransfer (void) noexcept;
+    void		SendFds (void) noexcept;
+private:
+    enum { c_SharedSends = 3, c_FdSends = 3, c_FdPartSize = 4096 };
+    // Transfer size is larger than ExtMsg body limit
+    static constexpr uint32_t c_TransferSize = 3*10*1024*1024+3;
+    PBlob		_blob;
+    PTransfer		_xfer;
+    PExtern		_extern;
+    memblock		_data;
+    Msg::SharedBody	_shared;
+    unsigned		_nsent;
+    unsigned		_nshared;
+    unsigned		_nfdrecv;
+    uint32_t		_xfersum;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Blob, BlobMsger)
+    REGISTER_MSGER (Transfer, BlobMsger)
+    REGISTER_EXTERN_MSGER (BlobR)
+    REGISTER_EXTERN_MSGER (TransferR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_blob (mrid_App)
+,_xfer (mrid_App)
+,_extern (mrid_App)
+,_data()
+,_shared()
+,_nsent()
+,_nshared()
+,_nfdrecv()
+,_xfersum()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd); pid < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!pid) {	// the child serves Blob on its end of the pipe
+	static const iid_t eil_Blob[] = { PBlob::Interface(), PTransfer::Interface(), nullptr };
+	return _extern.Open (fd, eil_Blob);
+    }
+    _extern.Open (fd);
+
+    // Fill the blob with a pattern
+    _data.resize (10*1024*1024);
+    for (auto i = 0u; i < _data.size(); ++i)
+	_data[i] = i*7 + (i>>12);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PBlob::Interface()))
+	return;	// the server side imports nothing
+    LOG ("Connected to Blob server\n");
+    _blob.Connect();
+    SendNext();
+}
+
+void TestApp::SendNext (void) noexcept
+{
+    static const uint32_t c_Sizes[] = { 0, 16, 4096, 1024*1024+4, 10*1024*1024 };
+    if (_nsent < ArraySize(c_Sizes))
+	return _blob.Put (cmemlink (_data.data(), c_Sizes[_nsent++]));
+    if (_nsent++ == ArraySize(c_Sizes))	// more segments than can be written at once
+	return _blob.Put (cmemlink (_data.data(), 1024*1024), 1024);
+    if (!_shared.empty())
+	return;
+    // Marshal one body and send it several times
+    cmemlink blob (_data.data(), 64*1024);
+    memblock body (variadic_stream_size (blob));
+    ostream os (body);
+    os << blob;
+    _shared = Msg::SharedBody (move (body));
+    for (auto i = 0u; i < c_SharedSends; ++i)
+	_blob.Put (_shared);
+}
+
+void TestApp::BlobR_Received (uint32_t sz, uint32_t sum) noexcept
+{
+    if (_nshared > c_SharedSends) {
+	if (!_nfdrecv++) {	// transfer completed
+	    LOG ("Transferred %u bytes, checksum %s\n", sz, sum == _xfersum ? "ok" : "bad");
+	    return SendFds();
+	}
+	// The memfds contain consecutive parts of the blob
+	LOG ("Received %u bytes in fds, checksum %s\n", sz, sum == Checksum (cmemlink (_data.data(), sz)) ? "ok" : "bad");
+	if (_nfdrecv > c_FdSends)
+	    Quit();
+	return;
+    }
+    LOG ("Received %u bytes, checksum %s\n", sz, sum == Checksum (cmemlink (_data.data(), sz)) ? "ok" : "bad");
+    if (_shared.empty())
+	return SendNext();
+    if (++_nshared < c_SharedSends)
+	return;
+    // All sent messages are written and destroyed by now
+    LOG ("Shared body has %u references\n", _shared.use_count());
+
+    // Stream an object in chunks, wrapping around _data
+    ++_nshared;
+    _xfer.CreateDestWith (PTransfer::Interface(), &Msger::Factory<COMRelay>);
+    _xfer.Open (c_TransferSize);
+    WriteTransfer();
+}
+
+void TestApp::WriteTransfer (void) noexcept
+{
+    while (_xfer.Sent() < c_TransferSize) {
+	auto offset = _xfer.Sent() % _data.size();
+	cmemlink chunk (_data.iat(offset), min (_data.size()-offset, c_TransferSize-_xfer.Sent()));
+	auto bw = _xfer.Write (chunk);
+	_xfersum = Checksum (cmemlink (chunk.data(), bw), _xfersum);
+	if (bw < chunk.size())
+	    return;	// window is full, continue when acknowledged
+    }
+    _xfer.Close();
+}
+
+// Sends messages with increasing numbers of fds without waiting for
+// replies, so that several are written to the socket together.
+void TestApp::SendFds (void) noexcept
+{
+    for (auto n = 1u; n <= c_FdSends; ++n) {
+	PExtern::fd_t fds [c_FdSends*2];
+	for (auto i = 0u; i < n*2; ++i) {
+	    fds[i] = memfd_create ("xbulk", MFD_CLOEXEC);
+	    if (fds[i] < 0)
+		return ErrorLibc ("memfd_create");
+	    if (c_FdPartSize != write (fds[i], _data.iat (i*c_FdPartSize), c_FdPartSize))
+		return ErrorLibc ("write");
+	}
+	_blob.PutFds (fds, n*2);
+    }
+}
+
+void TestApp::TransferR_Ack (uint32_t sz) noexcept
+{
+    _xfer.Acknowledged (sz);
+    if (_xfer.Sent() < c_TransferSize)
+	WriteTransfer();
+}
@@ -0,0 +1,101 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+
+//----------------------------------------------------------------------
+// xcall tests remote requests with deadlines. Many requests are sent
+// to one remote object without waiting for replies, and each reply
+// is matched to its request by the request id. A request the server
+// never replies to must time out. The server is a forked copy of this
+// process, connected by socketpair.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PCalcR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		OnRequestTimeout (Msg::reqid_t id) noexcept override;
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		CalcR_Result (uint32_t v) noexcept;
+private:
+			TestApp (void) noexcept;
+private:
+    enum { c_NRequests = 64, c_Timeout = 5000, c_HangTimeout = 50 };
+    PCalc		_calc;
+    PExtern		_extern;
+    Msg::reqid_t	_reqids [c_NRequests];
+    Msg::reqid_t	_hangid;
+    unsigned		_nreplies;
+    unsigned		_nmatched;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Calc, CalcMsger)
+    REGISTER_EXTERN_MSGER (CalcR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_calc (mrid_App)
+,_extern (mrid_App)
+,_reqids()
+,_hangid()
+,_nreplies()
+,_nmatched()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd); pid < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!pid) {	// the child serves Calc on its end of the pipe
+	static const iid_t eil_Calc[] = { PCalc::Interface(), nullptr };
+	return _extern.Open (fd, eil_Calc);
+    }
+    _extern.Open (fd);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PCalc::Interface()))
+	return;	// the server side imports nothing
+    _calc.Connect();
+    for (auto i = 0u; i < c_NRequests; ++i) {
+	_calc.Square (i);
+	_reqids[i] = _calc.Request (c_Timeout);
+    }
+}
+
+void TestApp::CalcR_Result (uint32_t v) noexcept
+{
+    auto replyid = DispatchedRequestId();
+    for (auto i = 0u; i < c_NRequests; ++i)
+	if (replyid != Msg::NoRequest && _reqids[i] == replyid && v == i*i)
+	    ++_nmatched;
+    if (++_nreplies < c_NRequests)
+	return;
+    LOG ("%u pipelined replies, %u matched their requests\n", _nreplies, _nmatched);
+    _calc.Hang();
+    _hangid = _calc.Request (c_HangTimeout);
+}
+
+void TestApp::OnRequestTimeout (Msg::reqid_t id) noexcept
+{
+    LOG ("Hang request %s\n", id == _hangid ? "timed out" : "has wrong id");
+    Quit();
+}
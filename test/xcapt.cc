@@ -0,0 +1,195 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <paths.h>
+#include <signal.h>
+
+//----------------------------------------------------------------------
+// xcapt tests capturing received messages, and replaying the capture.
+// Requests are sent to a forked server, connected by socketpair, which
+// captures them. The capture is then replayed with extreplay to another
+// server, a copy of this process run with -s to serve Calc on the
+// listening socket on stdin.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PCalcR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		CalcR_Result (uint32_t v) noexcept;
+private:
+			TestApp (void) noexcept;
+			~TestApp (void) noexcept override;
+    void		CheckCapture (void) noexcept;
+    void		Replay (void) noexcept;
+    void		Cleanup (void) noexcept;
+private:
+    enum { c_NRequests = 16, c_Timeout = 5000 };
+    PCalc		_calc;
+    PExtern		_extern;
+    PExternServer	_eserver;
+    unsigned		_nreplies;
+    pid_t		_capturer;
+    pid_t		_server;
+    char		_dir [sizeof(sockaddr_un::sun_path)-16];
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Calc, CalcMsger)
+    REGISTER_MSGER (ExternServer, ExternServer)
+    REGISTER_EXTERN_MSGER (CalcR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_calc (mrid_App)
+,_extern (mrid_App)
+,_eserver (mrid_App)
+,_nreplies()
+,_capturer()
+,_server()
+,_dir()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    static const iid_t eil_Calc[] = { PCalc::Interface(), nullptr };
+    for (int opt; 0 < (opt = getopt (argc, argv, "ds"));) {
+	if (opt == 's')	// serve Calc on the listening socket on stdin
+	    return _eserver.Open (STDIN_FILENO, eil_Calc, PExternServer::WhenEmpty::Remain);
+	#ifndef NDEBUG
+	    else if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+	#endif
+    }
+    snprintf (ArrayBlock(_dir), "%s/xcapt.XXXXXX", _PATH_TMP);
+    if (!mkdtemp (_dir))
+	return ErrorLibc ("mkdtemp");
+    // The listening socket is created here, so that extreplay
+    // does not have to wait for the server to start.
+    char path [sizeof(sockaddr_un::sun_path)];
+    snprintf (ArrayBlock(path), "%s/calc.socket", _dir);
+    if (0 > (_server = SpawnServer ("xcapt", path)))
+	return ErrorLibc ("failed to start the server");
+
+    snprintf (ArrayBlock(path), "%s/capture", _dir);
+    auto capfd = open (path, O_WRONLY| O_CREAT| O_TRUNC| O_CLOEXEC, 0600);
+    if (capfd < 0)
+	return ErrorLibc ("open capture");
+    PExtern::fd_t fd;
+    if (0 > (_capturer = ForkServer (fd)))
+	return ErrorLibc ("failed to start the capturing server");
+    else if (!_capturer) {	// the child serves Calc and captures the requests
+	_server = 0;
+	_dir[0] = 0;	// cleaned up by the parent
+	_extern.Open (fd, eil_Calc);
+	return _extern.Capture (capfd);
+    }
+    close (capfd);
+    _extern.Open (fd);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PCalc::Interface()))
+	return;	// the server side imports nothing
+    _calc.Connect();
+    for (auto i = 0u; i < c_NRequests; ++i) {
+	_calc.Square (i);
+	if (i % 2)	// half of the captured messages are requests
+	    _calc.Request (c_Timeout);
+    }
+}
+
+void TestApp::CalcR_Result (uint32_t) noexcept
+{
+    if (++_nreplies < c_NRequests)
+	return;
+    // Each message is captured before it is dispatched, so all are now
+    LOG ("%u replies received\n", _nreplies);
+    CheckCapture();
+    Replay();
+    Quit();
+}
+
+void TestApp::CheckCapture (void) noexcept
+{
+    char path [sizeof(sockaddr_un::sun_path)];
+    snprintf (ArrayBlock(path), "%s/capture", _dir);
+    memblock cap;
+    if (0 > cap.read_file (path))
+	return ErrorLibc ("read capture");
+    unsigned nmsgs = 0, nrequests = 0, nvalid = 0;
+    for (streamsize p = 0; p+sizeof(PExtern::CaptureRecord)+sizeof(Extern::FrameHeader) <= cap.size();) {
+	PExtern::CaptureRecord r;
+	Extern::FrameHeader h;
+	copy_n (cap.iat(p), sizeof(r), reinterpret_cast<char*>(&r));
+	copy_n (cap.iat(p+sizeof(r)), sizeof(h), reinterpret_cast<char*>(&h));
+	p += sizeof(r)+r.size;
+	if (h.extid == Extern::c_FrameExtidCOM)
+	    continue;	// link messages vary with timing, and are not counted
+	++nmsgs;
+	nvalid += r.size == streamsize(h.hsz)+h.sz && p <= cap.size();
+	nrequests += !!(h.flags & Extern::c_FrameRequestIdFlag);
+    }
+    LOG ("Captured %u messages, %u well formed, %u with request ids\n", nmsgs, nvalid, nrequests);
+}
+
+// extreplay reports throughput and latency, which vary between runs,
+// as does the number of skipped link messages, so only the message
+// counts are printed here.
+void TestApp::Replay (void) noexcept
+{
+    char cmd [2*sizeof(sockaddr_un::sun_path)+32];
+    snprintf (ArrayBlock(cmd), "extreplay -f %s/capture %s/calc.socket", _dir, _dir);
+    auto rf = popen (cmd, "r");
+    if (!rf)
+	return ErrorLibc ("popen");
+    char line [256];
+    unsigned n1, n2;
+    while (fgets (line, sizeof(line), rf)) {
+	if (1 == sscanf (line, "Replayed %u messages", &n1))
+	    LOG ("Replayed %u messages\n", n1);
+	else if (2 == sscanf (line, "%u replies to %u requests", &n1, &n2))
+	    LOG ("%u replies to %u requests\n", n1, n2);
+	else if (0 == strncmp (line, "Latency, us: p50 ", strlen("Latency, us: p50 ")))
+	    LOG ("Latency percentiles reported\n");
+    }
+    pclose (rf);
+}
+
+// The servers are stopped on exit, including on errors
+TestApp::~TestApp (void) noexcept
+{
+    if (_dir[0])
+	Cleanup();
+}
+
+void TestApp::Cleanup (void) noexcept
+{
+    for (auto pid : {_capturer, _server}) {
+	if (pid <= 0)
+	    continue;
+	kill (pid, SIGKILL);
+	waitpid (pid, nullptr, 0);
+    }
+    char path [sizeof(sockaddr_un::sun_path)];
+    for (auto name : {"capture", "calc.socket"}) {
+	snprintf (ArrayBlock(path), "%s/%s", _dir, name);
+	unlink (path);
+    }
+    rmdir (_dir);
+}
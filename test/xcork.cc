@@ -0,0 +1,166 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <netinet/tcp.h>
+
+//----------------------------------------------------------------------
+// xcork tests batching of outgoing messages. Of a burst of messages
+// sent in one dispatch, the first is written right away, and the rest
+// together, with one more syscall. Messages sent over
+// several loop iterations while the connection is corked are held, and
+// written together when flushed. The server is a forked copy of this
+// process, connected over TCP on the loopback interface.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PEchoR::Dispatch (this, msg)
+				|| PTimerR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		EchoR_Reply (uint32_t v) noexcept;
+    inline void		TimerR_Timer (PTimer::fd_t) noexcept;
+private:
+			TestApp (void) noexcept;
+    void		Send (unsigned n) noexcept;
+    void		Expect (unsigned n, const char* what) noexcept;
+    bool		SocketOption (int opt) const noexcept;
+private:
+    enum { c_BurstSize = 50, c_CorkedSize = 5, c_CorkedIterations = 4 };
+    PEcho		_echo;
+    PExtern		_extern;
+    PTimer		_timer;
+    const ExternInfo*	_einfo;
+    PExtern::fd_t	_sockfd;
+    const char*		_what;		// being tested
+    uint32_t		_nsent;
+    uint32_t		_nexpected;
+    uint32_t		_nreplies;
+    uint32_t		_writes;	// at start of the current test
+    unsigned		_stage;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Echo, EchoMsger)
+    REGISTER_EXTERN_MSGER (EchoR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_echo (mrid_App)
+,_extern (mrid_App)
+,_timer (mrid_App)
+,_einfo()
+,_sockfd (-1)
+,_what()
+,_nsent()
+,_nexpected()
+,_nreplies()
+,_writes()
+,_stage()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    sockaddr_in addr = {};
+    addr.sin_family = PF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    auto lfd = socket (PF_INET, SOCK_STREAM| SOCK_CLOEXEC, IPPROTO_IP);
+    if (lfd < 0 || 0 > bind (lfd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr))
+	    || 0 > listen (lfd, 1) || 0 > getsockname (lfd, reinterpret_cast<sockaddr*>(&addr), &addrlen))
+	return ErrorLibc ("failed to create the listening socket");
+    if (auto pid = fork(); pid < 0)
+	return ErrorLibc ("fork");
+    else if (!pid) {	// the child serves Echo
+	auto fd = accept4 (lfd, nullptr, nullptr, SOCK_NONBLOCK| SOCK_CLOEXEC);
+	close (lfd);
+	if (fd < 0)
+	    return ErrorLibc ("accept");
+	static const iid_t eil_Echo[] = { PEcho::Interface(), nullptr };
+	return _extern.Open (fd, eil_Echo, PExtern::SocketSide::Server);
+    }
+    close (lfd);
+    _sockfd = socket (PF_INET, SOCK_STREAM| SOCK_CLOEXEC, IPPROTO_IP);
+    if (_sockfd < 0 || 0 > connect (_sockfd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)))
+	return ErrorLibc ("connect");
+    _extern.Open (_sockfd);
+}
+
+bool TestApp::SocketOption (int opt) const noexcept
+{
+    int v = 0;
+    socklen_t l = sizeof(v);
+    return 0 <= getsockopt (_sockfd, IPPROTO_TCP, opt, &v, &l) && v;
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PEcho::Interface()))
+	return;	// the server side imports nothing
+    _einfo = einfo;
+    LOG ("TCP_NODELAY is %s\n", SocketOption (TCP_NODELAY) ? "set" : "not set");
+    _echo.Connect();
+    Expect (c_BurstSize, "A burst of messages");
+    Send (c_BurstSize);
+}
+
+void TestApp::Send (unsigned n) noexcept
+{
+    for (auto i = 0u; i < n; ++i)
+	_echo.Echo (_nsent++);
+}
+
+// Starts a test, expecting n replies
+void TestApp::Expect (unsigned n, const char* what) noexcept
+{
+    _what = what;
+    _nexpected = n;
+    _nreplies = 0;
+    _writes = _einfo->traffic.writes;
+}
+
+// Messages corked over several iterations, on the timer
+void TestApp::TimerR_Timer (PTimer::fd_t) noexcept
+{
+    Send (c_CorkedSize);
+    if (++_stage < c_CorkedIterations)
+	return _timer.Timer (0);
+    LOG ("TCP_CORK is %s while corked\n", SocketOption (TCP_CORK) ? "set" : "not set");
+    _extern.Flush();
+}
+
+void TestApp::EchoR_Reply (uint32_t) noexcept
+{
+    if (++_nreplies < _nexpected)
+	return;
+    auto nwrites = _einfo->traffic.writes - _writes;
+    LOG ("%s written in %s\n", _what, nwrites == 1 ? "one write" : (nwrites == 2 ? "two writes" : "several"));
+    if (!_stage) {
+	Expect (c_CorkedSize*c_CorkedIterations, "Corked messages");
+	_extern.Cork();
+	_timer.Timer (0);
+    } else if (_stage == c_CorkedIterations) {
+	++_stage;
+	Expect (1, "A single uncorked message");
+	_extern.Cork (false);
+	Send (1);
+    } else {
+	LOG ("TCP_CORK is %s after uncorking\n", SocketOption (TCP_CORK) ? "set" : "not set");
+	Quit();
+    }
+}
@@ -0,0 +1,113 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <fcntl.h>
+
+//----------------------------------------------------------------------
+// xhuge tests refusing messages too large to export. The client, a
+// forked copy of this process connected by socketpair, sends a body
+// larger than the header can describe. It must be refused with an
+// error, which the client handles by sending a small body, which must
+// be the only one received here. The client's output is discarded,
+// since an error prints a backtrace in debug builds.
+
+// Logs the size of each received body
+class LogMsger : public Msger {
+public:
+    explicit	LogMsger (const Msg::Link& l)	: Msger(l),_reply(l) {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PData::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    inline void	Data_Put (const cmemlink& data) {
+		    LOG ("Received %u bytes\n", data.size());
+		    _reply.Received (data.size());
+		}
+private:
+    PDataR	_reply;
+};
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PDataR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    bool		OnError (mrid_t eid, const string& errmsg) noexcept override;
+    void		OnMsgerDestroyed (mrid_t mid) noexcept override;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		DataR_Received (uint32_t) noexcept	{ Quit(); }
+private:
+			TestApp (void) noexcept;
+private:
+    enum { c_SmallSize = 64 };
+    PData		_huge;
+    PData		_small;
+    PExtern		_extern;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Data, LogMsger)
+    REGISTER_EXTERN_MSGER (DataR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_huge (mrid_App)
+,_small (mrid_App)
+,_extern (mrid_App)
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd); pid < 0)
+	return ErrorLibc ("failed to start the client");
+    else if (!pid) {	// the child is the client
+	if (auto nfd = open ("/dev/null", O_WRONLY| O_CLOEXEC); nfd >= 0) {
+	    dup2 (nfd, STDOUT_FILENO);
+	    close (nfd);
+	}
+	return _extern.Open (fd);
+    }
+    static const iid_t eil_Data[] = { PData::Interface(), nullptr };
+    _extern.Open (fd, eil_Data);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PData::Interface()))
+	return;	// the server side imports nothing
+    memblock huge (1<<24);
+    _huge.Connect();
+    _huge.Put (huge);
+}
+
+// The refused message is reported as an error in the relay
+bool TestApp::OnError (mrid_t eid, const string& errmsg) noexcept
+{
+    if (eid != _huge.Dest())
+	return App::OnError (eid, errmsg);
+    _small.Connect();
+    _small.Put (memblock (c_SmallSize));
+    return true;
+}
+
+// The server quits when the client does
+void TestApp::OnMsgerDestroyed (mrid_t mid) noexcept
+{
+    App::OnMsgerDestroyed (mid);
+    if (mid == _extern.Dest())
+	Quit();
+}
@@ -0,0 +1,90 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <signal.h>
+#include <sys/wait.h>
+
+//----------------------------------------------------------------------
+// xlive tests keepalive on an Extern connection. The server is a forked
+// copy of this process, connected by socketpair. An idle connection
+// must stay open while the server answers pings. Then the server is
+// stopped, without closing its socket, and the connection must be
+// closed when the keepalive timeout expires.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PTimerR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		OnMsgerDestroyed (mrid_t mid) noexcept override;
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		TimerR_Timer (PTimer::fd_t) noexcept;
+private:
+			TestApp (void) noexcept;
+private:
+    // Idle time is several timeouts, to fail if pings are not answered
+    enum { c_PingInterval = 20, c_Timeout = 200, c_IdleTime = 3*c_Timeout };
+    PExtern		_extern;
+    PTimer		_idle;
+    pid_t		_server;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_extern (mrid_App)
+,_idle (mrid_App)
+,_server()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (_server = ForkServer (fd); _server < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!_server) {	// the child only answers pings, without enabling keepalive
+	static const iid_t eil_None[] = { nullptr };
+	return _extern.Open (fd, eil_None);
+    }
+    _extern.Open (fd);
+    _extern.KeepAlive (c_PingInterval, c_Timeout);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (einfo->side == PExtern::SocketSide::Client)
+	_idle.Timer (c_IdleTime);
+}
+
+void TestApp::TimerR_Timer (PTimer::fd_t) noexcept
+{
+    LOG ("Idle connection kept alive\n");
+    kill (_server, SIGSTOP);	// stops answering, with the socket open
+}
+
+void TestApp::OnMsgerDestroyed (mrid_t mid) noexcept
+{
+    App::OnMsgerDestroyed (mid);
+    if (mid != _extern.Dest() || !_server)
+	return;
+    LOG ("Dead peer connection closed\n");
+    kill (_server, SIGKILL);
+    waitpid (_server, nullptr, 0);
+    Quit();
+}
@@ -0,0 +1,241 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <sys/mman.h>
+
+//----------------------------------------------------------------------
+// xpack tests Extern connections on SOCK_SEQPACKET sockets, where each
+// message is one packet. Many messages of different sizes are sent at
+// once, followed by messages passing fds, and a transfer of an object
+// larger than a packet. The server is a forked copy of this process,
+// connected by socketpair.
+
+class PBlob : public Proxy {
+    DECLARE_INTERFACE (Blob, (Put,"ay")(PutFd,"h"))
+public:
+    explicit	PBlob (mrid_t caller) : Proxy (caller) {}
+    void	Connect (void)	{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Put (const cmemlink& data)	{ Send (M_Put(), data); }
+    void	PutFd (PExtern::fd_t fd) {
+		    auto& msg = CreateMsg (M_PutFd(), stream_size_of(fd), 0);
+		    auto os = msg.Write();
+		    os << fd;
+		    CommitMsg (msg, os);
+		}
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	auto is = msg.Read();
+	if (msg.Method() == M_Put()) {
+	    cmemlink data; data.link_read (is);
+	    o->Blob_Put (data);
+	} else if (msg.Method() == M_PutFd())
+	    o->Blob_PutFd (is.readv<PExtern::fd_t>());
+	else
+	    return false;
+	return true;
+    }
+};
+
+class PBlobR : public ProxyR {
+    DECLARE_INTERFACE (BlobR, (Received,"uu"))
+public:
+    explicit	PBlobR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Received (uint32_t sz, uint32_t sum)	{ Send (M_Received(), sz, sum); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Received())
+	    return false;
+	auto is = msg.Read();
+	auto sz = is.readv<uint32_t>();
+	auto sum = is.readv<uint32_t>();
+	o->BlobR_Received (sz, sum);
+	return true;
+    }
+};
+
+DEFINE_INTERFACE (Blob)
+DEFINE_INTERFACE (BlobR)
+
+static uint32_t Checksum (const cmemlink& data, uint32_t sum = 0)
+{
+    for (auto c : data)
+	sum = Rol (sum, 1u) ^ uint8_t(c);
+    return sum;
+}
+
+//----------------------------------------------------------------------
+
+class BlobMsger : public Msger {
+public:
+    explicit	BlobMsger (const Msg::Link& l)	: Msger(l),_reply(l),_ack(l),_size(),_sum() {}
+    bool	Dispatch (Msg& msg) noexcept override {
+		    return PBlob::Dispatch (this, msg)
+			|| PTransfer::Dispatch (this, msg)
+			|| Msger::Dispatch (msg);
+		}
+    inline void	Blob_Put (const cmemlink& data)	{ _reply.Received (data.size(), Checksum (data)); }
+    void	Blob_PutFd (PExtern::fd_t fd) noexcept;
+    inline void	Transfer_Open (uint64_t)	{ _size = 0; _sum = 0; }
+    inline void	Transfer_Data (const cmemlink& chunk) {
+		    _size += chunk.size();
+		    _sum = Checksum (chunk, _sum);
+		    _ack.Ack (chunk.size());
+		}
+    inline void	Transfer_Close (void)		{ _reply.Received (_size, _sum); }
+private:
+    PBlobR	_reply;
+    PTransferR	_ack;
+    uint32_t	_size;
+    uint32_t	_sum;
+};
+
+void BlobMsger::Blob_PutFd (PExtern::fd_t fd) noexcept
+{
+    uint32_t size = 0, sum = 0;
+    char buf [4096];
+    for (ssize_t br, o = 0; 0 < (br = pread (fd, buf, sizeof(buf), o)); o += br, size += br)
+	sum = Checksum (cmemlink (buf, br), sum);
+    close (fd);
+    _reply.Received (size, sum);
+}
+
+//----------------------------------------------------------------------
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PBlobR::Dispatch (this, msg)
+				|| PTransferR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		BlobR_Received (uint32_t sz, uint32_t sum) noexcept;
+    inline void		TransferR_Ack (uint32_t sz) noexcept;
+private:
+			TestApp (void) noexcept;
+    static uint32_t	PutSize (unsigned i)	{ return i*i*31 % (Extern::c_MaxPacketSize/2); }
+    void		WriteTransfer (void) noexcept;
+private:
+    enum { c_NPuts = 64, c_NFds = 4, c_FdPartSize = 4096 };
+    static constexpr uint32_t c_TransferSize = 4*Extern::c_MaxPacketSize+3;
+    PBlob		_blob;
+    PTransfer		_xfer;
+    PExtern		_extern;
+    memblock		_data;
+    unsigned		_nreplies;
+    unsigned		_nmatched;
+    uint32_t		_xfersum;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Blob, BlobMsger)
+    REGISTER_MSGER (Transfer, BlobMsger)
+    REGISTER_EXTERN_MSGER (BlobR)
+    REGISTER_EXTERN_MSGER (TransferR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_blob (mrid_App)
+,_xfer (mrid_App)
+,_extern (mrid_App)
+,_data()
+,_nreplies()
+,_nmatched()
+,_xfersum()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd, SOCK_SEQPACKET); pid < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!pid) {	// the child serves Blob on its end of the pipe
+	static const iid_t eil_Blob[] = { PBlob::Interface(), PTransfer::Interface(), nullptr };
+	return _extern.Open (fd, eil_Blob);
+    }
+    _extern.Open (fd);
+
+    // Fill the blob with a pattern
+    _data.resize (Extern::c_MaxPacketSize);
+    for (auto i = 0u; i < _data.size(); ++i)
+	_data[i] = i*7 + (i>>12);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PBlob::Interface()))
+	return;	// the server side imports nothing
+    LOG ("Connected on a %s socket%s\n", einfo->isSeqPacket ? "packet" : "stream",
+	    einfo->isSharedMemory ? ", with shared memory" : "");
+    // Sent without waiting, so several packets are queued at once
+    _blob.Connect();
+    for (auto i = 0u; i < c_NPuts; ++i)
+	_blob.Put (cmemlink (_data.data(), Align (PutSize(i), 4)));
+}
+
+void TestApp::BlobR_Received (uint32_t sz, uint32_t sum) noexcept
+{
+    if (auto n = _nreplies++; n < c_NPuts) {
+	// Replies arrive in the order sent
+	auto psz = Align (PutSize(n), 4);
+	_nmatched += sz == psz && sum == Checksum (cmemlink (_data.data(), psz));
+	if (n+1 < c_NPuts)
+	    return;
+	LOG ("%u of %u messages received whole and in order\n", _nmatched, c_NPuts);
+	// Each fd arrives with the packet of its message
+	for (auto f = 0u; f < c_NFds; ++f) {
+	    auto fd = memfd_create ("xpack", MFD_CLOEXEC);
+	    if (fd < 0)
+		return ErrorLibc ("memfd_create");
+	    if (c_FdPartSize*(f+1) != write (fd, _data.data(), c_FdPartSize*(f+1)))
+		return ErrorLibc ("write");
+	    _blob.PutFd (fd);
+	}
+    } else if (n < c_NPuts+c_NFds) {
+	auto fsz = c_FdPartSize*(n-c_NPuts+1);
+	LOG ("Received %u bytes in fd, checksum %s\n", sz, sz == fsz && sum == Checksum (cmemlink (_data.data(), fsz)) ? "ok" : "bad");
+	if (n+1 < c_NPuts+c_NFds)
+	    return;
+	// Objects larger than a packet are sent in chunks
+	_xfer.CreateDestWith (PTransfer::Interface(), &Msger::Factory<COMRelay>);
+	_xfer.Open (c_TransferSize);
+	WriteTransfer();
+    } else {
+	LOG ("Transferred %u bytes, checksum %s\n", sz, sum == _xfersum ? "ok" : "bad");
+	Quit();
+    }
+}
+
+void TestApp::WriteTransfer (void) noexcept
+{
+    while (_xfer.Sent() < c_TransferSize) {
+	auto offset = _xfer.Sent() % _data.size();
+	cmemlink chunk (_data.iat(offset), min (_data.size()-offset, c_TransferSize-_xfer.Sent()));
+	auto bw = _xfer.Write (chunk);
+	_xfersum = Checksum (cmemlink (chunk.data(), bw), _xfersum);
+	if (bw < chunk.size())
+	    return;	// window is full, continue when acknowledged
+    }
+    _xfer.Close();
+}
+
+void TestApp::TransferR_Ack (uint32_t sz) noexcept
+{
+    _xfer.Acknowledged (sz);
+    if (_xfer.Sent() < c_TransferSize)
+	WriteTransfer();
+}
@@ -0,0 +1,167 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+
+//----------------------------------------------------------------------
+// xpool tests launching servers from an ExternPool. The servers are
+// copies of this process, run with -p to serve Proc on stdin. Then it
+// tests balancing relays between two servers, and failing over when
+// one of them is closed.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PExternPoolR::Dispatch (this, msg)
+				|| PProcR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		OnMsgerDestroyed (mrid_t mid) noexcept override;
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternPoolR_Launched (PExternPool::fd_t fd) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		ProcR_Pid (int32_t pid) noexcept;
+private:
+			TestApp (void) noexcept;
+    void		BalancedPid (int32_t pid) noexcept;
+private:
+    // Launches are more than the warm count, to test replenishment.
+    // Each server is closed before the next is launched, since relays
+    // connect to the first Extern importing the interface.
+    enum { c_NWarm = 2, c_NLaunches = 4, c_NBalanced = 2, c_NRelays = 4 };
+    PExternPool		_pool;
+    PExtern		_externs [c_NLaunches];
+    PProc		_procs [c_NLaunches];
+    int32_t		_pids [c_NLaunches];
+    unsigned		_nlaunched;
+    PExtern		_balanced [c_NBalanced];
+    PProc		_brelays [c_NRelays];
+    int32_t		_bpids [c_NRelays];
+    unsigned		_nbalanced;
+    unsigned		_nconnected;
+    unsigned		_nreplies;
+    PExtern		_server;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Proc, ProcMsger)
+    REGISTER_MSGER (ExternPool, ExternPool)
+    REGISTER_EXTERN_MSGER (ProcR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_pool (mrid_App)
+,_externs {PExtern(mrid_App),PExtern(mrid_App),PExtern(mrid_App),PExtern(mrid_App)}
+,_procs {PProc(mrid_App),PProc(mrid_App),PProc(mrid_App),PProc(mrid_App)}
+,_pids()
+,_nlaunched()
+,_balanced {PExtern(mrid_App),PExtern(mrid_App)}
+,_brelays {PProc(mrid_App),PProc(mrid_App),PProc(mrid_App),PProc(mrid_App)}
+,_bpids()
+,_nbalanced()
+,_nconnected()
+,_nreplies()
+,_server (mrid_App)
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    for (int opt; 0 < (opt = getopt (argc, argv, "dp"));) {
+	if (opt == 'p') {	// serve Proc on the pipe from the pool
+	    static const iid_t eil_Proc[] = { PProc::Interface(), nullptr };
+	    return _server.Open (STDIN_FILENO, eil_Proc);
+	}
+	#ifndef NDEBUG
+	    else if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+	#endif
+    }
+    _pool.Open ("xpool", "-p", c_NWarm);
+    _pool.Launch();
+}
+
+void TestApp::ExternPoolR_Launched (PExternPool::fd_t fd) noexcept
+{
+    if (_nlaunched < c_NLaunches)
+	_externs[_nlaunched++].Open (fd);
+    else
+	_balanced[_nbalanced++].Open (fd);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PProc::Interface()))
+	return;	// the server side imports nothing
+    if (!_nbalanced) {
+	_procs[_nlaunched-1].Connect();
+	_procs[_nlaunched-1].Pid();
+    } else if (++_nconnected == c_NBalanced) {
+	// Each relay is bound to an Extern when its first message is sent
+	for (auto& r : _brelays) {
+	    r.Connect();
+	    r.Pid();
+	}
+    }
+}
+
+void TestApp::ProcR_Pid (int32_t pid) noexcept
+{
+    if (_nbalanced)
+	return BalancedPid (pid);
+    auto n = _nlaunched-1;
+    _pids[n] = pid;
+    bool isnew = pid != getpid();
+    for (auto i = 0u; i < n; ++i)
+	if (_pids[i] == pid)
+	    isnew = false;
+    LOG ("Launched server %u, pid is %s\n", _nlaunched, isnew ? "new" : "reused");
+    _externs[n].Close();	// and launch the next when closed
+}
+
+static unsigned CountPid (const int32_t* pids, unsigned n, int32_t pid)
+{
+    auto r = 0u;
+    for (auto i = 0u; i < n; ++i)
+	r += pids[i] == pid;
+    return r;
+}
+
+void TestApp::BalancedPid (int32_t pid) noexcept
+{
+    _bpids[_nreplies++ % c_NRelays] = pid;
+    if (_nreplies == c_NRelays) {
+	auto nfirst = CountPid (ArrayBlock(_bpids), _bpids[0]);
+	LOG ("Balanced %u relays over %u servers: %u and %u\n", c_NRelays, c_NBalanced, nfirst, c_NRelays-nfirst);
+	_balanced[0].Close();	// and resend when closed
+    } else if (_nreplies == 2*c_NRelays) {
+	LOG ("Failed over %u relays to the remaining server\n", CountPid (ArrayBlock(_bpids), _bpids[0]));
+	Quit();
+    }
+}
+
+void TestApp::OnMsgerDestroyed (mrid_t mid) noexcept
+{
+    App::OnMsgerDestroyed (mid);
+    if (_nbalanced) {
+	if (mid != _balanced[0].Dest())
+	    return;
+	// Relays on the closed server now go to the remaining one
+	for (auto& r : _brelays)
+	    r.Pid();
+    } else if (!_nlaunched || mid != _externs[_nlaunched-1].Dest())
+	return;
+    else if (_nlaunched < c_NLaunches)
+	_pool.Launch();
+    else {
+	Extern::SetBalance (PProc::Interface(), PExtern::Balance::RoundRobin);
+	for (auto i = 0u; i < c_NBalanced; ++i)
+	    _pool.Launch();
+    }
+}
@@ -0,0 +1,211 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+
+//----------------------------------------------------------------------
+// xprio tests message priorities. Locally, a high priority message
+// overtakes those queued on another link, but not on its own. Then
+// a high priority message is sent to the server while bulk data is
+// being written to it, and must overtake most of it. The server is
+// a forked copy of this process, connected by socketpair.
+
+class PSeq : public Proxy {
+    DECLARE_INTERFACE (Seq, (Put,"uay"))
+public:
+    explicit	PSeq (mrid_t caller)	: Proxy (caller) {}
+    void	CreateLocal (void)	{ CreateDestAs (Interface()); }
+    void	CreateRemote (void)	{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Put (uint32_t id, const cmemlink& data = cmemlink())	{ Send (M_Put(), id, data); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Put())
+	    return false;
+	auto is = msg.Read();
+	auto id = is.readv<uint32_t>();
+	cmemlink data; data.link_read (is);
+	o->Seq_Put (id, data);
+	return true;
+    }
+};
+
+class PSeqR : public ProxyR {
+    DECLARE_INTERFACE (SeqR, (Arrived,"uu"))
+public:
+    explicit	PSeqR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Arrived (uint32_t id, uint32_t n)	{ Send (M_Arrived(), id, n); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Arrived())
+	    return false;
+	auto is = msg.Read();
+	auto id = is.readv<uint32_t>();
+	auto n = is.readv<uint32_t>();
+	o->SeqR_Arrived (id, n);
+	return true;
+    }
+};
+
+DEFINE_INTERFACE (Seq)
+DEFINE_INTERFACE (SeqR)
+
+static uint32_t s_NArrived = 0;	// by all SeqMsgers
+
+// Replies with the number of messages received before each
+class SeqMsger : public Msger {
+public:
+    explicit	SeqMsger (const Msg::Link& l)	: Msger(l),_reply(l) {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PSeq::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    inline void	Seq_Put (uint32_t id, const cmemlink&)	{ _reply.Arrived (id, s_NArrived++); }
+private:
+    PSeqR	_reply;
+};
+
+//----------------------------------------------------------------------
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PSeqR::Dispatch (this, msg)
+				|| PTimerR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		SeqR_Arrived (uint32_t id, uint32_t n) noexcept;
+    inline void		TimerR_Timer (PTimer::fd_t) noexcept;
+private:
+			TestApp (void) noexcept;
+    void		LocalArrived (uint32_t id) noexcept;
+    void		RemoteArrived (uint32_t id, uint32_t n) noexcept;
+private:
+    enum : uint32_t {
+	c_NLocal = 4,
+	c_NBulk = 16,
+	c_BulkSize = 1024*1024,
+	c_UrgentId = 100
+    };
+    PSeq		_first;
+    PSeq		_second;
+    PSeq		_bulk;
+    PSeq		_urgent;
+    PExtern		_extern;
+    PTimer		_timer;
+    memblock		_data;
+    uint32_t		_nreplies;
+    uint32_t		_urgentn;	// messages arrived before the urgent one
+    uint32_t		_nbulk;		// replies to bulk messages
+    uint32_t		_lastn;		// of the last bulk message
+    bool		_bulkInOrder;
+    char		_localOrder [c_NLocal*2+1];
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Seq, SeqMsger)
+    REGISTER_EXTERN_MSGER (SeqR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_first (mrid_App)
+,_second (mrid_App)
+,_bulk (mrid_App)
+,_urgent (mrid_App)
+,_extern (mrid_App)
+,_timer (mrid_App)
+,_data (c_BulkSize)
+,_nreplies()
+,_urgentn()
+,_nbulk()
+,_lastn()
+,_bulkInOrder (true)
+,_localOrder()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd); pid < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!pid) {	// the child serves Seq
+	static const iid_t eil_Seq[] = { PSeq::Interface(), nullptr };
+	return _extern.Open (fd, eil_Seq, PExtern::SocketSide::Server, PExtern::Compression::Off, PExtern::Transport::Socket);
+    }
+    _extern.Open (fd, nullptr, PExtern::SocketSide::Client, PExtern::Compression::Off, PExtern::Transport::Socket);
+}
+
+// Local messages 1 and 2 are on the first link, 3 on the second,
+// and 4 on the first. 3 and 4 are high priority, so 3 overtakes
+// 1 and 2, while 4 can not overtake them on its own link.
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PSeq::Interface()))
+	return;	// the server side imports nothing
+    _first.CreateLocal();
+    _second.CreateLocal();
+    _first.Put (1);
+    _first.Put (2);
+    _second.Put (3);
+    _second.Prioritize (Msg::Priority::High);
+    _first.Put (4);
+    _first.Prioritize (Msg::Priority::High);
+}
+
+void TestApp::SeqR_Arrived (uint32_t id, uint32_t n) noexcept
+{
+    if (_nreplies < c_NLocal)
+	LocalArrived (id);
+    else
+	RemoteArrived (id, n);
+}
+
+void TestApp::LocalArrived (uint32_t id) noexcept
+{
+    _localOrder[_nreplies*2] = '0'+id;
+    _localOrder[_nreplies*2+1] = ' ';
+    if (++_nreplies < c_NLocal)
+	return;
+    _localOrder[c_NLocal*2-1] = 0;
+    LOG ("Local messages arrived in order %s\n", _localOrder);
+
+    // The urgent message is sent after the bulk data is queued
+    _bulk.CreateRemote();
+    for (auto i = 0u; i < c_NBulk; ++i)
+	_bulk.Put (i, _data);
+    _timer.Timer (0);
+}
+
+void TestApp::TimerR_Timer (PTimer::fd_t) noexcept
+{
+    _urgent.CreateRemote();
+    _urgent.Put (c_UrgentId);
+    _urgent.Prioritize (Msg::Priority::High);
+}
+
+void TestApp::RemoteArrived (uint32_t id, uint32_t n) noexcept
+{
+    if (id == c_UrgentId)
+	_urgentn = n;
+    else {	// replies on the bulk link are in the order received
+	if (id != _nbulk++ || (id && n <= _lastn))
+	    _bulkInOrder = false;
+	_lastn = n;
+    }
+    if (++_nreplies < c_NLocal+c_NBulk+1)
+	return;
+    LOG ("Bulk messages arrived %s\n", _bulkInOrder ? "in order" : "out of order");
+    LOG ("The urgent message arrived %s\n", _urgentn < c_NBulk/2 ? "ahead of most bulk data" : "behind the bulk data");
+    Quit();
+}
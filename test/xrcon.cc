@@ -0,0 +1,124 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+//----------------------------------------------------------------------
+// xrcon tests reconnecting client Externs. The server is a copy of this
+// process, run with -s to serve Proc on the listening socket on stdin.
+// It is killed after replying, and a request is sent while no server
+// is running. The request must be buffered, and sent through the same
+// relay to the restarted server when the client reconnects.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PProcR::Dispatch (this, msg)
+				|| PTimerR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		ProcR_Pid (int32_t pid) noexcept;
+    inline void		TimerR_Timer (PTimer::fd_t) noexcept;
+private:
+			TestApp (void) noexcept;
+    void		StopServer (pid_t pid) noexcept;
+private:
+    // Long enough for the client to notice the lost connection
+    enum { c_DownTime = 50 };
+    PExtern		_extern;
+    PExternServer	_eserver;
+    PProc		_proc;
+    PTimer		_down;
+    pid_t		_server;
+    unsigned		_nconnected;
+    sockaddr_un		_addr;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Proc, ProcMsger)
+    REGISTER_MSGER (ExternServer, ExternServer)
+    REGISTER_EXTERN_MSGER (ProcR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_extern (mrid_App)
+,_eserver (mrid_App)
+,_proc (mrid_App)
+,_down (mrid_App)
+,_server()
+,_nconnected()
+,_addr{}
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    for (int opt; 0 < (opt = getopt (argc, argv, "ds"));) {
+	if (opt == 's') {	// serve Proc on the listening socket on stdin
+	    static const iid_t eil_Proc[] = { PProc::Interface(), nullptr };
+	    return _eserver.Open (STDIN_FILENO, eil_Proc);
+	}
+	#ifndef NDEBUG
+	    else if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+	#endif
+    }
+    _addr.sun_family = PF_LOCAL;
+    snprintf (ArrayBlock(_addr.sun_path), "/tmp/xrcon.%d.socket", getpid());
+    if (0 > (_server = SpawnServer ("xrcon", _addr.sun_path)))
+	return ErrorLibc ("failed to start server");
+    if (0 > _extern.ConnectLocal (_addr.sun_path))
+	return ErrorLibc ("ConnectLocal");
+    _extern.Reconnect();
+}
+
+// The listening socket is created here, so that the client can connect
+// when the server has not yet started, and passed to the server on stdin.
+void TestApp::StopServer (pid_t pid) noexcept
+{
+    kill (pid, SIGKILL);
+    waitpid (pid, nullptr, 0);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PProc::Interface()))
+	return;
+    if (_nconnected++) {
+	LOG ("Reconnected\n");
+	return;
+    }
+    _proc.Connect();
+    _proc.Pid();
+}
+
+void TestApp::ProcR_Pid (int32_t pid) noexcept
+{
+    StopServer (_server);
+    if (pid == _server && _nconnected == 1) {
+	LOG ("Server replied\n");
+	_down.Timer (c_DownTime);	// and send the request when disconnected
+	return;
+    }
+    LOG ("Buffered request %s\n", pid == _server ? "answered by the restarted server" : "answered by the wrong server");
+    unlink (_addr.sun_path);
+    Quit();
+}
+
+void TestApp::TimerR_Timer (PTimer::fd_t) noexcept
+{
+    _proc.Pid();
+    if (0 > (_server = SpawnServer ("xrcon", _addr.sun_path)))
+	return ErrorLibc ("failed to restart server");
+}
@@ -0,0 +1,205 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+
+//----------------------------------------------------------------------
+// xsplc tests splicing data through an Extern connection. A file and a
+// pipe are spliced to the server, a forked copy of this process, which
+// writes them to a file. After each, the server is asked for the hash
+// of the data sent so far, which must be in its file, since messages
+// sent after the data are delivered after it is written.
+
+class PSink : public Proxy {
+    DECLARE_INTERFACE (Sink, (Check,"t"))
+public:
+    explicit	PSink (mrid_t caller)	: Proxy (caller) {}
+    void	Connect (void)		{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Check (uint64_t sz)	{ Send (M_Check(), sz); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Check())
+	    return false;
+	o->Sink_Check (msg.Read().readv<uint64_t>());
+	return true;
+    }
+};
+
+class PSinkR : public ProxyR {
+    DECLARE_INTERFACE (SinkR, (Checked,"tt"))
+public:
+    explicit	PSinkR (const Msg::Link& l)	: ProxyR (l) {}
+    void	Checked (uint64_t sz, uint64_t hash)	{ Send (M_Checked(), sz, hash); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Checked())
+	    return false;
+	auto is = msg.Read();
+	auto sz = is.readv<uint64_t>();
+	auto hash = is.readv<uint64_t>();
+	o->SinkR_Checked (sz, hash);
+	return true;
+    }
+};
+
+DEFINE_INTERFACE (Sink)
+DEFINE_INTERFACE (SinkR)
+
+// FNV-1a, continued from h
+static uint64_t Hash (const char* p, size_t n, uint64_t h = UINT64_C(14695981039346656037))
+{
+    for (auto i = 0u; i < n; ++i)
+	h = (h ^ uint8_t(p[i])) * UINT64_C(1099511628211);
+    return h;
+}
+
+static PExtern::fd_t s_SinkFd = -1;
+
+class SinkMsger : public Msger {
+public:
+    explicit	SinkMsger (const Msg::Link& l)	: Msger(l),_reply(l) {}
+    bool	Dispatch (Msg& msg) noexcept override
+		    { return PSink::Dispatch (this, msg) || Msger::Dispatch (msg); }
+    inline void	Sink_Check (uint64_t sz) noexcept;
+private:
+    PSinkR	_reply;
+};
+
+// Replies with the hash of the first sz bytes, or fewer if not there
+void SinkMsger::Sink_Check (uint64_t sz) noexcept
+{
+    uint64_t hsz = 0, hash = Hash (nullptr, 0);
+    char buf [64*1024];
+    for (ssize_t br; 0 < (br = pread (s_SinkFd, buf, min (sz-hsz, sizeof(buf)), hsz)); hsz += br)
+	hash = Hash (buf, br, hash);
+    _reply.Checked (hsz, hash);
+}
+
+//----------------------------------------------------------------------
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PSinkR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		SinkR_Checked (uint64_t sz, uint64_t hash) noexcept;
+private:
+			TestApp (void) noexcept;
+    PExtern::fd_t	CreateFile (void) noexcept;
+    PExtern::fd_t	CreatePipe (void) noexcept;
+    void		Check (void) noexcept;
+private:
+    // Not a multiple of the pipe size, nor of the page size
+    enum : uint64_t { c_FileSize = 4*1024*1024+12345, c_PipeDataSize = 4000 };
+    PSink		_sink;
+    PExtern		_extern;
+    uint64_t		_size;	// of data sent so far
+    uint64_t		_hash;
+    uint64_t		_checked [2];	// _hash at each Check
+    unsigned		_nchecks;
+    unsigned		_nreplies;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Sink, SinkMsger)
+    REGISTER_EXTERN_MSGER (SinkR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_sink (mrid_App)
+,_extern (mrid_App)
+,_size()
+,_hash (Hash (nullptr, 0))
+,_checked{}
+,_nchecks()
+,_nreplies()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd); pid < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!pid) {	// the child serves Sink, writing received data to a file
+	if (0 > (s_SinkFd = memfd_create ("xsplc.sink", MFD_CLOEXEC)))
+	    return ErrorLibc ("memfd_create");
+	static const iid_t eil_Sink[] = { PSink::Interface(), nullptr };
+	_extern.Open (fd, eil_Sink, PExtern::SocketSide::Server, PExtern::Compression::Auto, PExtern::Transport::Socket);
+	return _extern.SpliceTo (dup (s_SinkFd));	// the Extern closes its copy
+    }
+    _extern.Open (fd, nullptr, PExtern::SocketSide::Client, PExtern::Compression::Auto, PExtern::Transport::Socket);
+}
+
+auto TestApp::CreateFile (void) noexcept -> PExtern::fd_t
+{
+    auto fd = memfd_create ("xsplc.data", MFD_CLOEXEC);
+    memblock data (c_FileSize);
+    for (auto i = 0u; i < data.size(); ++i)
+	data[i] = i*7 ^ (i >> 11);
+    if (fd < 0 || data.size() != write (fd, data.data(), data.size()) || 0 > lseek (fd, 0, SEEK_SET)) {
+	ErrorLibc ("failed to create the data file");
+	return -1;
+    }
+    _size += data.size();
+    _hash = Hash (data.data(), data.size(), _hash);
+    return fd;
+}
+
+// The data fits in the pipe buffer, and is written before splicing
+auto TestApp::CreatePipe (void) noexcept -> PExtern::fd_t
+{
+    int p[2];
+    char data [c_PipeDataSize];
+    for (auto i = 0u; i < sizeof(data); ++i)
+	data[i] = 'a' + i % 26;
+    if (0 > pipe2 (p, O_CLOEXEC) || sizeof(data) != write (p[1], data, sizeof(data))) {
+	ErrorLibc ("failed to create the data pipe");
+	return -1;
+    }
+    close (p[1]);
+    _size += sizeof(data);
+    _hash = Hash (data, sizeof(data), _hash);
+    return p[0];
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PSink::Interface()))
+	return;	// the server side imports nothing
+    _sink.Connect();
+    _extern.Splice (CreateFile(), c_FileSize);
+    Check();
+    _extern.Splice (CreatePipe(), c_PipeDataSize);
+    Check();
+}
+
+void TestApp::Check (void) noexcept
+{
+    _checked[_nchecks++] = _hash;
+    _sink.Check (_size);
+}
+
+void TestApp::SinkR_Checked (uint64_t sz, uint64_t hash) noexcept
+{
+    static const char* c_What[] = { "a file", "a pipe" };
+    LOG ("Sink has %lu bytes after splicing %s, %s\n", sz, c_What[_nreplies], hash == _checked[_nreplies] ? "all as sent" : "differing");
+    if (++_nreplies >= ArraySize(c_What))
+	Quit();
+}
@@ -0,0 +1,110 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "common.h"
+
+//----------------------------------------------------------------------
+// xstat tests Extern traffic statistics. Messages of different sizes
+// are sent to the server, and then the server is queried for its
+// statistics, which must match those counted on this side. The server
+// is a forked copy of this process, connected by socketpair.
+
+class TestApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static TestApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override {
+			    return PDataR::Dispatch (this, msg)
+				|| PExternStatsR::Dispatch (this, msg)
+				|| PExternR::Dispatch (this, msg)
+				|| App::Dispatch (msg);
+			}
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+    inline void		DataR_Received (uint32_t sz) noexcept;
+    inline void		ExternStatsR_Stats (const PExternStatsR::connections_t& conns) noexcept;
+private:
+			TestApp (void) noexcept;
+    static uint32_t	PutSize (unsigned i)	{ return Align (i*i*97 % 65536, 4); }
+private:
+    enum { c_NPuts = 64 };
+    PData		_data;
+    PExternStats	_stats;
+    PExtern		_extern;
+    const ExternInfo*	_einfo;
+    memblock		_buf;
+    unsigned		_nreplies;
+};
+
+BEGIN_CWICLO_APP (TestApp)
+    REGISTER_MSGER (Data, DataMsger)
+    REGISTER_MSGER (ExternStats, ExternStats)
+    REGISTER_EXTERN_MSGER (DataR)
+    REGISTER_EXTERN_MSGER (ExternStatsR)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+TestApp::TestApp (void) noexcept
+: App()
+,_data (mrid_App)
+,_stats (mrid_App)
+,_extern (mrid_App)
+,_einfo()
+,_buf (65536)
+,_nreplies()
+{
+}
+
+void TestApp::ProcessArgs (argc_t argc [[maybe_unused]], argv_t argv [[maybe_unused]]) noexcept
+{
+    #ifndef NDEBUG
+	for (int opt; 0 < (opt = getopt (argc, argv, "d"));)
+	    if (opt == 'd')
+		SetFlag (f_DebugMsgTrace);
+    #endif
+    PExtern::fd_t fd;
+    if (auto pid = ForkServer (fd); pid < 0)
+	return ErrorLibc ("failed to start the server");
+    else if (!pid) {	// the child serves Data and its statistics
+	static const iid_t eil_Data[] = { PData::Interface(), PExternStats::Interface(), nullptr };
+	return _extern.Open (fd, eil_Data);
+    }
+    _extern.Open (fd);
+}
+
+void TestApp::ExternR_Connected (const ExternInfo* einfo) noexcept
+{
+    if (!einfo->IsImporting (PData::Interface()))
+	return;	// the server side imports nothing
+    _einfo = einfo;
+    _data.Connect();
+    for (auto i = 0u; i < c_NPuts; ++i)
+	_data.Put (cmemlink (_buf.data(), PutSize(i)));
+}
+
+void TestApp::DataR_Received (uint32_t) noexcept
+{
+    if (++_nreplies < c_NPuts)
+	return;
+    LOG ("Received %u replies\n", _nreplies);
+    _stats.Open();
+    _stats.Query();
+}
+
+void TestApp::ExternStatsR_Stats (const PExternStatsR::connections_t& conns) noexcept
+{
+    LOG ("Server has %u connection with %hu relays\n", conns.size(), conns.empty() ? 0 : conns[0].nrelays);
+    if (conns.empty())
+	return Quit();
+    auto& st = conns[0].traffic;
+    auto& ct = _einfo->traffic;
+    // The query is counted on both sides, but its reply only here
+    LOG ("Server received %s\n", st.msgsIn == ct.msgsOut && st.bytesIn == ct.bytesOut ? "all sent messages and bytes" : "a different count");
+    LOG ("Server sent %s\n", st.msgsOut+1 == ct.msgsIn ? "all received messages" : "a different count");
+    LOG ("Server peer pid is %s\n", conns[0].peerpid == getpid() ? "ours" : "wrong");
+    LOG ("Queue lengths are %s\n", st.maxQueued && ct.maxQueued ? "recorded" : "not recorded");
+    LOG ("Queue times are %s\n", st.maxQueueTime*st.msgsOut >= st.queueTime && ct.maxQueueTime*ct.msgsOut >= ct.queueTime ? "consistent" : "inconsistent");
+    LOG ("Writes are %s\n", st.writes && ct.writes ? "counted" : "not counted");
+    Quit();
+}
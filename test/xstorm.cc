@@ -0,0 +1,174 @@
+// This file is part of the cwiclo project
+//
+// Copyright (c) 2018 by Mike Sharov <msharov@users.sourceforge.net>
+// This file is free software, distributed under the MIT License.
+
+#include "../xcom.h"
+#include <sys/wait.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+using namespace cwiclo;
+
+//----------------------------------------------------------------------
+// xstorm measures how fast ExternServer accepts connections on a
+// loopback TCP port. Client processes open connections as fast as they
+// can, each waiting for the server's handshake message. The server is
+// run as one listener, and as several worker processes listening on
+// the same port with SO_REUSEPORT. Run with make bench; not a make
+// check test.
+
+static uint64_t NowUs (void)
+{
+    timespec t;
+    clock_gettime (CLOCK_MONOTONIC, &t);
+    return t.tv_sec*UINT64_C(1000000) + t.tv_nsec/1000;
+}
+
+//----------------------------------------------------------------------
+
+class StormApp : public App {
+public:
+    static auto&	Instance (void) noexcept { static StormApp s_App; return s_App; }
+    bool		Dispatch (Msg& msg) noexcept override
+			    { return PExternR::Dispatch (this, msg) || App::Dispatch (msg); }
+    void		ProcessArgs (argc_t argc, argv_t argv) noexcept;
+    inline void		ExternR_Connected (const ExternInfo*) noexcept {}
+private:
+			StormApp (void) noexcept : App(),_server (mrid_App),_nconns (10000),_nclients (4) {}
+    bool		RunStorm (unsigned nworkers) noexcept;
+    bool		RunClient (const sockaddr_in& addr, unsigned nconns) noexcept;
+private:
+    enum { c_MaxOpenConns = 128 };
+    PExternServer	_server;
+    unsigned		_nconns;
+    unsigned		_nclients;
+};
+
+BEGIN_CWICLO_APP (StormApp)
+    REGISTER_MSGER (ExternServer, ExternServer)
+    REGISTER_EXTERNS
+END_CWICLO_APP
+
+void StormApp::ProcessArgs (argc_t argc, argv_t argv) noexcept
+{
+    unsigned nworkers = 4;
+    for (int opt; 0 < (opt = getopt (argc, argv, "n:w:"));) {
+	if (opt == 'n')
+	    _nconns = atoi (optarg);
+	else if (opt == 'w')
+	    nworkers = max (atoi (optarg), 1);
+	else {
+	    printf ("Usage: xstorm [-n count] [-w workers]\n"
+		    "  -n\tnumber of connections to make\n"
+		    "  -w\tnumber of SO_REUSEPORT listeners\n");
+	    exit (EXIT_SUCCESS);
+	}
+    }
+    _nclients = nworkers;
+    if (RunStorm (1) && (nworkers <= 1 || RunStorm (nworkers)))
+	exit (EXIT_SUCCESS);
+}
+
+// Returns false in worker processes, which then serve in the App loop
+bool StormApp::RunStorm (unsigned nworkers) noexcept
+{
+    // Find a free port for the listeners. Each run uses a new one,
+    // since connections of the previous may still hold the port.
+    sockaddr_in addr = {};
+    addr.sin_family = PF_INET;
+    addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    auto pfd = socket (PF_INET, SOCK_STREAM| SOCK_CLOEXEC, IPPROTO_IP);
+    if (pfd < 0 || 0 > bind (pfd, reinterpret_cast<const sockaddr*>(&addr), addrlen)
+	    || 0 > getsockname (pfd, reinterpret_cast<sockaddr*>(&addr), &addrlen)) {
+	ErrorLibc ("bind");
+	return false;
+    }
+    close (pfd);
+
+    // Each worker process listens on the port and reports when ready
+    int ready[2];
+    if (0 > pipe2 (ready, O_CLOEXEC)) {
+	ErrorLibc ("pipe");
+	return false;
+    }
+    fflush (stdout);
+    pid_t workers [nworkers];
+    for (auto i = 0u; i < nworkers; ++i) {
+	if ((workers[i] = fork()) < 0) {
+	    ErrorLibc ("fork");
+	    return false;
+	} else if (!workers[i]) {
+	    static const iid_t eil_None[] = { nullptr };
+	    close (ready[0]);
+	    if (0 > _server.BindLocalIP4 (addr.sin_port, eil_None, nworkers > 1 ? PExternServer::ReusePort::On : PExternServer::ReusePort::Off))
+		ErrorLibc ("BindLocalIP4");
+	    else if (char b = 0; sizeof(b) != write (ready[1], &b, sizeof(b)))
+		ErrorLibc ("write");
+	    close (ready[1]);
+	    return false;
+	}
+    }
+    close (ready[1]);
+    char buf [nworkers];
+    for (ssize_t br, n = 0; n < ssize_t(nworkers); n += br) {
+	if (0 >= (br = read (ready[0], buf, nworkers-n))) {
+	    Error ("worker failed to start");
+	    return false;
+	}
+    }
+    close (ready[0]);
+
+    auto starttime = NowUs();
+    for (auto i = 0u; i < _nclients; ++i) {
+	if (auto pid = fork(); pid < 0) {
+	    ErrorLibc ("fork");
+	    return false;
+	} else if (!pid)
+	    exit (RunClient (addr, _nconns/_nclients) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    auto nfailed = 0u;
+    for (auto i = 0u; i < _nclients; ++i)
+	if (int status = 0; 0 > wait (&status) || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+	    ++nfailed;
+    auto elapsed = NowUs() - starttime;
+
+    for (auto w : workers)
+	kill (w, SIGTERM);
+    for (auto w : workers)
+	waitpid (w, nullptr, 0);
+
+    auto nconns = _nconns/_nclients*_nclients;
+    printf ("%u listener%s %u connections in %.1f ms, %.0f accepts/s%s\n",
+	    nworkers, nworkers > 1 ? "s:" : ": ", nconns, elapsed/1000.,
+	    nconns*1000000./max(elapsed,uint64_t(1)), nfailed ? ", FAILED" : "");
+    return true;
+}
+
+// Opens connections in batches of c_MaxOpenConns, waiting for
+// the handshake on each before closing it.
+bool StormApp::RunClient (const sockaddr_in& addr, unsigned nconns) noexcept
+{
+    int fds [c_MaxOpenConns];
+    for (auto i = 0u; i < nconns;) {
+	auto nb = min (nconns-i, unsigned(c_MaxOpenConns));
+	for (auto j = 0u; j < nb; ++j) {
+	    fds[j] = socket (PF_INET, SOCK_STREAM| SOCK_CLOEXEC, IPPROTO_IP);
+	    if (fds[j] < 0 || 0 > connect (fds[j], reinterpret_cast<const sockaddr*>(&addr), sizeof(addr))) {
+		perror ("connect");
+		return false;
+	    }
+	}
+	for (auto j = 0u; j < nb; ++j) {
+	    char buf [256];
+	    if (0 >= read (fds[j], buf, sizeof(buf))) {
+		perror ("read");
+		return false;
+	    }
+	    close (fds[j]);
+	}
+	i += nb;
+    }
+    return true;
+}
@@ -135,8 +135,9 @@ public:
 					os << ios::talign<T>();
 				    if constexpr (is_trivially_copyable<T>::value) {
 					if constexpr (Stm::is_writing)
-					    copy_n (begin(), size(), os.template ptr<T>());
-					os.skip (bsize());
+					    os.write (data(), bsize());
+					else
+					    os.skip (bsize());
 				    } else for (const auto& i : *this)
 					os << i;
 				    if constexpr (stream_align<T>::value < stream_align<size_type>::value)
@@ -4,10 +4,18 @@
 // This file is free software, distributed under the MIT License.
 
 #include "xcom.h"
+#include "compress.h"
 #include <fcntl.h>
+#include <netinet/tcp.h>
 #include <sys/un.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <paths.h>
+#include <spawn.h>
+#include <signal.h>
+#include <time.h>
 #if __has_include(<arpa/inet.h>) && !defined(NDEBUG)
     #include <arpa/inet.h>
 #endif
@@ -39,19 +47,52 @@ Msg PCOM::ExportMsg (mrid_t extid, const string& elstr) noexcept // static
 Msg PCOM::ErrorMsg (mrid_t extid, const string& errmsg) noexcept // static
 {
     Msg msg (Msg::Link{}, PCOM::M_Error(), stream_size_of(errmsg), extid);
+    msg.SetPriority (Msg::Priority::High);
     auto os = msg.Write();
     os << errmsg;
     return msg;
 }
 
+Msg PCOM::DeleteMsg (mrid_t extid) noexcept // static
+{
+    Msg msg (Msg::Link{}, PCOM::M_Delete(), 0, extid);
+    msg.SetPriority (Msg::Priority::High);
+    return msg;
+}
+
+Msg PCOM::RingMsg (mrid_t extid, fd_t fd) noexcept // static
+{
+    Msg msg (Msg::Link{}, PCOM::M_Ring(), stream_size_of(fd), extid, 0);
+    auto os = msg.Write();
+    os << fd;
+    return msg;
+}
+
+Msg PCOM::PingMsg (mrid_t extid, bool isreply) noexcept // static
+{
+    Msg msg (Msg::Link{}, PCOM::M_Ping(), stream_size_of(isreply), extid);
+    msg.SetPriority (Msg::Priority::High);
+    auto os = msg.Write();
+    os << isreply;
+    return msg;
+}
+
+Msg PCOM::StreamMsg (mrid_t extid, uint64_t size) noexcept // static
+{
+    Msg msg (Msg::Link{}, PCOM::M_Stream(), stream_size_of(size), extid);
+    auto os = msg.Write();
+    os << size;
+    return msg;
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ PExtern
 
 DEFINE_INTERFACE (Extern)
 
-auto PExtern::Connect (const sockaddr* addr, socklen_t addrlen) noexcept -> fd_t
+auto PExtern::ConnectSocket (const sockaddr* addr, socklen_t addrlen, int socktype) noexcept -> fd_t // static
 {
-    auto fd = socket (addr->sa_family, SOCK_STREAM| SOCK_NONBLOCK| SOCK_CLOEXEC, IPPROTO_IP);
+    auto fd = socket (addr->sa_family, socktype| SOCK_NONBLOCK| SOCK_CLOEXEC, IPPROTO_IP);
     if (fd < 0)
 	return fd;
     if (0 > connect (fd, addr, addrlen) && errno != EINPROGRESS && errno != EINTR) {
@@ -59,12 +100,25 @@ auto PExtern::Connect (const sockaddr* addr, socklen_t addrlen) noexcept -> fd_t
 	close (fd);
 	return fd = -1;
     }
-    Open (fd);
     return fd;
 }
 
+auto PExtern::Connect (const sockaddr* addr, socklen_t addrlen, int socktype) noexcept -> fd_t
+{
+    auto fd = ConnectSocket (addr, addrlen, socktype);
+    if (fd >= 0)
+	Open (fd);
+    return fd;
+}
+
+/// Connect to the broker daemon
+auto PExtern::ConnectBroker (void) noexcept -> fd_t
+{
+    return ConnectUserLocal (PExternBroker::c_SocketName);
+}
+
 /// Create local socket with given path
-auto PExtern::ConnectLocal (const char* path) noexcept -> fd_t
+auto PExtern::ConnectLocal (const char* path, int socktype) noexcept -> fd_t
 {
     sockaddr_un addr;
     addr.sun_family = PF_LOCAL;
@@ -73,7 +127,7 @@ auto PExtern::ConnectLocal (const char* path) noexcept -> fd_t
 	return -1;
     }
     DEBUG_PRINTF ("[X] Connecting to socket %s\n", addr.sun_path);
-    return Connect (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    return Connect (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), socktype);
 }
 
 /// Create local socket of the given name in the system standard location for such
@@ -155,41 +209,51 @@ auto PExtern::ConnectLocalIP6 (in_port_t port) noexcept -> fd_t
     return Connect (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
 }
 
-auto PExtern::LaunchPipe (const char* exe, const char* arg) noexcept -> fd_t
+// Launches exefp with a socket pipe on its stdin. posix_spawn does not
+// copy the address space, as fork would, so the cost does not grow with
+// the size of the parent process. Returns the client side of the pipe
+// and the server pid, or -1 on failure.
+//
+static PExtern::fd_t SpawnPipe (const char* exefp, const char* exe, const char* arg, pid_t& pid) noexcept
 {
-    // Check if executable exists before the fork to allow proper error handling
-    char exepath [PATH_MAX];
-    auto exefp = executable_in_path (exe, ArrayBlock(exepath));
-    if (!exefp) {
-	errno = ENOENT;
-	return -1;
-    }
-
-    // Create socket pipe, will be connected to stdin in server
+    // Create socket pipe, will be connected to stdin in server.
+    // Both are close-on-exec; dup2 clears it on the server's stdin.
     enum { socket_ClientSide, socket_ServerSide, socket_N };
-    fd_t socks [socket_N];
-    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK, 0, socks))
+    PExtern::fd_t socks [socket_N];
+    if (0 > socketpair (PF_LOCAL, SOCK_STREAM| SOCK_NONBLOCK| SOCK_CLOEXEC, 0, socks))
 	return -1;
 
-    if (auto fr = fork(); fr < 0) {
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init (&fa);
+    posix_spawn_file_actions_adddup2 (&fa, socks[socket_ServerSide], STDIN_FILENO);
+    char* argv[] = { const_cast<char*>(exe), const_cast<char*>(arg), nullptr };
+    auto r = posix_spawn (&pid, exefp, &fa, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy (&fa);
+    close (socks[socket_ServerSide]);
+    if (r) {
 	close (socks[socket_ClientSide]);
-	close (socks[socket_ServerSide]);
+	errno = r;
 	return -1;
-    } else if (!fr) {	// Server side
-	close (socks[socket_ClientSide]);
-	dup2 (socks[socket_ServerSide], STDIN_FILENO);
-	execl (exefp, exe, arg, NULL);
-
-	// If exec failed, log the error and exit
-	Msger::Error ("failed to launch pipe to '%s %s': %s\n", exe, arg, strerror(errno));
-	exit (EXIT_FAILURE);
     }
-    // Client side
-    close (socks[socket_ServerSide]);
-    Open (socks[socket_ClientSide]);
     return socks[socket_ClientSide];
 }
 
+auto PExtern::LaunchPipe (const char* exe, const char* arg) noexcept -> fd_t
+{
+    // Check if executable exists before the spawn to allow proper error handling
+    char exepath [PATH_MAX];
+    auto exefp = executable_in_path (exe, ArrayBlock(exepath));
+    if (!exefp) {
+	errno = ENOENT;
+	return -1;
+    }
+    pid_t pid;
+    auto fd = SpawnPipe (exefp, exe, arg, pid);
+    if (fd >= 0)
+	Open (fd);
+    return fd;
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ PExternR
 
@@ -202,24 +266,63 @@ Extern::Extern (const Msg::Link& l) noexcept
 : Msger (l)
 ,_sockfd (-1)
 ,_timer (MsgerId())
+,_self (MsgerId(), MsgerId())
 ,_reply (l)
 ,_bwritten (0)
 ,_outq()
+,_wbuf()
 ,_relays()
+,_relayByExtid()
 ,_einfo{}
 ,_bread (0)
 ,_inmsg()
-,_infd (-1)
+,_infds()
+,_rbuf()
+,_rbufp()
+,_txring()
+,_rxring()
+,_nsockmsgs()
+,_pinginterval()
+,_deadtimeout()
+,_lastheard()
+,_lastping()
+,_maxbuffered()
+,_redialdelay()
+,_peeraddrlen()
+,_peeraddr()
+,_capfd (-1)
+,_lastcap()
+,_batchtime()
+,_spliceout (MsgerId())
+,_splicein (MsgerId())
+,_splicesrc()
 {
     _relays.emplace_back (MsgerId(), MsgerId(), extid_COM);
-    ExternList().push_back (this);
+    IndexRelay (0);
+    auto& et = ExternTable();
+    if (MsgerId() >= et.size())
+	et.resize (MsgerId()+1, nullptr);
+    et[MsgerId()] = this;
 }
 
 Extern::~Extern (void) noexcept
 {
     Extern_Close();
-    remove_if (ExternList(), [&](const Extern* e)
-	{ return e == this; });
+    _self.Detach();	// the id is freed by the App
+    // The tables may already be destroyed at exit, and then are empty
+    if (auto& et = ExternTable(); MsgerId() < et.size())
+	et[MsgerId()] = nullptr;
+    // Unindexed first, so that relays do not fail over to this one
+    UnindexImports();
+    for (auto& r : _relays)
+	if (auto rl = LookupRelayLoc (r.relay.Dest()); rl && rl->pExtern == this)
+	    *rl = {};
+    // Relays created by local callers are not notified by the App,
+    // since this Extern did not create them. Those that fail over
+    // are detached, so that their mrids are not freed here.
+    for (auto& r : _relays)
+	if (r.pRelay && r.pRelay->OnExternDestroyed())
+	    r.relay.Detach();
 }
 
 bool Extern::Dispatch (Msg& msg) noexcept
@@ -232,27 +335,117 @@ bool Extern::Dispatch (Msg& msg) noexcept
 
 void Extern::QueueOutgoing (Msg&& msg) noexcept
 {
-    _outq.emplace_back (move (msg));
-    TimerR_Timer (_sockfd);
+    // The body size must fit into the 24 bits of the header
+    if (auto bsz = Align (msg.Size(), Msg::Alignment::Body); bsz > ExtMsg::c_MaxBodySize)
+	return Error ("message body of %u bytes is too large to export; use the Transfer interface", bsz);
+    // A packet socket takes one whole message per packet
+    if (_einfo.isSeqPacket && (ExtMsg::ExportSize (msg) > c_MaxPacketSize || ExtMsg::ExportIOVecCount (msg) > c_MaxIOVecs))
+	return Error ("message too large for a packet socket");
+    if (msg.FdCount() > 1 && !Flag (f_PeerExtended))
+	return Error ("the peer does not accept fd arrays");
+    auto& emsg = Enqueue (move (msg));
+    if (_einfo.isCompressed)
+	emsg.Compress();
+    _einfo.traffic.maxQueued = max (_einfo.traffic.maxQueued, _outq.size());
+    if (_sockfd < 0) {	// buffered while reconnecting
+	if (_peeraddrlen && _outq.size() > _maxbuffered) {
+	    DEBUG_PRINTF ("[XE] %hu.Extern: reconnect buffer is full, closing\n", MsgerId());
+	    Extern_Close();
+	}
+	return;
+    }
+    // Messages queued after the first in this loop iteration are written
+    // together by the flush, after all of them. While corked, only link
+    // messages are flushed, with those before them.
+    if (Flag (f_FlushQueued) || (Flag (f_Corked) && emsg.Extid() != extid_COM))
+	return;
+    SetFlag (f_FlushQueued);
+    _self.Flush();
+    // The first is written right away, unless held by the cork or
+    // earlier messages. If the socket is full, the flush waits for it.
+    if (_outq.size() == 1 && !Flag (f_Corked))
+	WriteOutgoing();
+}
+
+// Queue times are measured with a monotonic microsecond clock
+static uint64_t NowUs (void) noexcept
+{
+    struct timespec t;
+    if (0 > clock_gettime (CLOCK_MONOTONIC, &t))
+	return 0;
+    return uint64_t(t.tv_nsec) / 1000 + t.tv_sec * uint64_t(1000000);
+}
+
+// Queues msg by its priority. The partially written message, and those
+// to be written on the socket before switching to the ring, stay first.
+//
+// To not read the clock for every message, queue times are measured
+// from the first message of a batch: those queued in one loop iteration,
+// or, while corked, since the queue was last empty.
+auto Extern::Enqueue (Msg&& msg) noexcept -> ExtMsg&
+{
+    if (!Flag (f_PeerExtended)) {	// the peer can not parse these
+	msg.SetRequestId (Msg::NoRequest);
+	msg.SetPriority (Msg::Priority::Normal);
+    }
+    if (Flag (f_Corked) ? _outq.empty() : !Flag (f_FlushQueued))
+	_batchtime = NowUs();
+    OutQueue::size_type minpos = !!_bwritten;
+    if (_txring.IsOpen())
+	minpos = max (minpos, _nsockmsgs);
+    auto& emsg = _outq.emplace_back (move (msg), minpos);
+    emsg.SetQueuedAt (_batchtime);
+    return emsg;
+}
+
+auto Extern::LookupRelayLoc (mrid_t id) noexcept -> RelayLoc* // static
+{
+    auto& rt = RelayTable();
+    return id < rt.size() ? &rt[id] : nullptr;
 }
 
 Extern::RelayProxy* Extern::RelayProxyById (mrid_t id) noexcept
 {
-    return linear_search_if (_relays, [&](const auto& r)
-	    { return r.relay.Dest() == id; });
+    auto rl = LookupRelayLoc (id);
+    if (!rl)	// the index may already be destroyed at exit
+	return linear_search_if (_relays, [&](const auto& r) { return r.relay.Dest() == id; });
+    if (rl->pExtern != this)
+	return nullptr;
+    return &_relays[rl->pos];
 }
 
 Extern::RelayProxy* Extern::RelayProxyByExtid (mrid_t extid) noexcept
 {
-    return linear_search_if (_relays, [&](const auto& r)
-	    { return r.extid == extid; });
+    auto slot = ExtidSlot (extid);
+    if (slot >= _relayByExtid.size() || _relayByExtid[slot] == c_NoRelay)
+	return nullptr;
+    return &_relays[_relayByExtid[slot]];
+}
+
+// Adds _relays[pos] to the extid and relay id indexes
+void Extern::IndexRelay (mrid_t pos) noexcept
+{
+    auto& r = _relays[pos];
+    auto slot = ExtidSlot (r.extid);
+    if (slot >= _relayByExtid.size())
+	_relayByExtid.resize (slot+1, c_NoRelay);
+    _relayByExtid[slot] = pos;
+    auto rid = r.relay.Dest();
+    if (rid > mrid_Last)
+	return;	// the relay Msger could not be created
+    auto& rt = RelayTable();
+    if (rid >= rt.size())
+	rt.resize (rid+1, RelayLoc{});
+    rt[rid] = { this, pos };
 }
 
-mrid_t Extern::RegisterRelay (const COMRelay* relay) noexcept
+mrid_t Extern::RegisterRelay (COMRelay* relay) noexcept
 {
     auto rp = RelayProxyById (relay->MsgerId());
-    if (!rp)
+    if (!rp) {
 	rp = &_relays.emplace_back (MsgerId(), relay->MsgerId(), CreateExtidFromRelayId (relay->MsgerId()));
+	IndexRelay (_relays.size()-1);
+    }
     rp->pRelay = relay;
     return rp->extid;
 }
@@ -260,29 +453,139 @@ mrid_t Extern::RegisterRelay (const COMRelay* relay) noexcept
 void Extern::UnregisterRelay (const COMRelay* relay) noexcept
 {
     auto rp = RelayProxyById (relay->MsgerId());
-    if (rp)
-	_relays.erase (rp);
+    if (!rp)
+	return;
+    _relayByExtid[ExtidSlot (rp->extid)] = c_NoRelay;
+    if (auto rl = LookupRelayLoc (relay->MsgerId()); rl)
+	*rl = {};
+    auto pos = rp - _relays.begin();
+    _relays.erase (rp);
+    for (auto i = pos; i < _relays.size(); ++i)
+	IndexRelay (i);	// relays after the erased one have moved
 }
 
 Extern* Extern::LookupById (mrid_t id) noexcept // static
 {
-    auto ep = linear_search_if (ExternList(), [&](const auto e)
-		{ return e->MsgerId() == id; });
-    return ep ? *ep : nullptr;
+    auto& et = ExternTable();
+    return id < et.size() ? et[id] : nullptr;
 }
 
-Extern* Extern::LookupByImported (iid_t iid) noexcept // static
+auto Extern::LookupImportLoc (iid_t iid) noexcept -> ImportLoc* // static
 {
-    auto ep = linear_search_if (ExternList(), [&](const auto e)
-		{ return e->Info().IsImporting(iid); });
-    return ep ? *ep : nullptr;
+    // Searches only the interfaces imported by any Extern, not the Externs
+    return linear_search_if (ImportTable(), [&](const auto& i)
+		{ return i.iid == iid; });
+}
+
+// Rendezvous hash score of an Extern for a key. The Extern with the
+// highest score is chosen, so removing one only moves its own keys.
+static uint32_t BalanceScore (mrid_t key, mrid_t eid)
+{
+    auto h = (uint32_t(key) << 16 | eid) * 2654435761u;
+    h ^= h >> 15;
+    h *= 2246822519u;
+    return h ^ (h >> 13);
+}
+
+// Chooses an Extern importing iid by its balancing policy,
+// with key identifying the caller for the Hash policy.
+Extern* Extern::LookupByImported (iid_t iid, mrid_t key) noexcept // static
+{
+    auto ip = LookupImportLoc (iid);
+    if (!ip)
+	return nullptr;
+    Extern* r = nullptr;
+    auto& ev = ip->externs;
+    if (ip->balance == PExtern::Balance::RoundRobin) {
+	if (!ev.empty())
+	    r = ev[ip->next++ % ev.size()];
+    } else for (auto e : ev) {
+	if (!r)
+	    r = e;
+	else if (ip->balance == PExtern::Balance::LeastQueued) {
+	    if (e->_outq.size() < r->_outq.size()
+		    || (e->_outq.size() == r->_outq.size() && e->_relays.size() < r->_relays.size()))
+		r = e;
+	} else if (ip->balance == PExtern::Balance::Hash) {
+	    if (BalanceScore (key, e->MsgerId()) > BalanceScore (key, r->MsgerId()))
+		r = e;
+	} else
+	    break;	// Balance::First
+    }
+    return r;
+}
+
+// Sets the balancing policy for relays to the given imported interface.
+// It is kept while no Externs import it, and can be set before connecting.
+void Extern::SetBalance (iid_t iid, PExtern::Balance b) noexcept // static
+{
+    auto ip = LookupImportLoc (iid);
+    if (!ip)
+	ip = &ImportTable().emplace_back (ImportLoc { iid, b, 0, {} });
+    ip->balance = b;
+}
+
+// Allows peers with the given uid and gid to create objects of the
+// exported interface iid. Once it has a rule, no other peers can.
+// Rules are checked when the peer creates an object, and a denied
+// peer sees it deleted right away.
+void Extern::Allow (iid_t iid, uid_t uid, gid_t gid) noexcept // static
+{
+    AccessTable().push_back (AccessRule { iid, uid, gid });
+}
+
+// Checks if the peer may create objects of the exported iid. Peers
+// not passing credentials have them received with pid 0.
+bool Extern::IsAccessible (iid_t iid) const noexcept
+{
+    auto& c = _einfo.creds;
+    bool restricted = false;
+    for (auto& r : AccessTable()) {
+	if (r.iid != iid)
+	    continue;
+	if (c.pid && (r.uid == AnyId || r.uid == c.uid)
+		&& (r.gid == AnyId || r.gid == c.gid))
+	    return true;
+	restricted = true;
+    }
+    return !restricted;
+}
+
+bool Extern::CanFailover (iid_t iid) noexcept // static
+{
+    auto ip = LookupImportLoc (iid);
+    return ip && ip->balance != PExtern::Balance::First;
 }
 
 Extern* Extern::LookupByRelayId (mrid_t rid) noexcept // static
 {
-    auto ep = linear_search_if (ExternList(), [&](const auto e)
-		{ return nullptr != e->RelayProxyById (rid); });
-    return ep ? *ep : nullptr;
+    auto rl = LookupRelayLoc (rid);
+    return rl ? rl->pExtern : nullptr;
+}
+
+// Adds this Extern to ImportTable for each interface it imports
+void Extern::IndexImports (void) noexcept
+{
+    for (auto iid : _einfo.imported) {
+	auto ip = LookupImportLoc (iid);
+	if (!ip)
+	    ip = &ImportTable().emplace_back (ImportLoc { iid, PExtern::Balance::First, 0, {} });
+	ip->externs.push_back (this);
+    }
+}
+
+// Removes this Extern from ImportTable. Interfaces no longer imported
+// are removed, unless a balancing policy was set for them.
+void Extern::UnindexImports (void) noexcept
+{
+    auto& it = ImportTable();
+    for (auto i = it.begin(); i < it.end();) {
+	remove_if (i->externs, [&](auto e){ return e == this; });
+	if (i->externs.empty() && i->balance == PExtern::Balance::First)
+	    i = it.erase (i);
+	else
+	    ++i;
+    }
 }
 
 //}}}-------------------------------------------------------------------
@@ -290,60 +593,200 @@ Extern* Extern::LookupByRelayId (mrid_t rid) noexcept // static
 
 Extern::ExtMsg::ExtMsg (Msg&& msg) noexcept
 :_body (msg.MoveBody())
-,_h { Align (_body.size(), Msg::Alignment::Body)
+,_chain (msg.MoveChain())
+,_h { Align (_body.size()+SegmentsSize(), Msg::Alignment::Body)
+    , uint8_t((msg.FdCount() > 1 ? BitMask (hf_FdArray) : 0)
+	    | (msg.RequestId() != Msg::NoRequest ? BitMask (hf_RequestId) : 0)
+	    | (msg.GetPriority() == Msg::Priority::Low ? BitMask (hf_LowPriority) : 0)
+	    | (msg.GetPriority() == Msg::Priority::High ? BitMask (hf_HighPriority) : 0))
     , msg.Extid()
     , msg.FdOffset()
-    , WriteHeaderStrings (msg.Method()) }
+    , HeaderSizeFor (msg.Method(), msg.RequestId() != Msg::NoRequest) }
+,_reqid (msg.RequestId())
+,_method (msg.Method())
+,_queued()
+,_hstr()
 {
-    assert (_body.capacity() >= _h.sz && "message body must be created aligned to Msg::Alignment::Body");
-    _body.memlink::resize (_h.sz);
+    assert (_h.sz == Align (_body.size()+SegmentsSize(), Msg::Alignment::Body) && "oversized messages must be refused by QueueOutgoing");
+    assert ((!HasFd() || _h.fdoffset+msg.FdCount()*sizeof(fd_t) <= _body.size()) && "passed fds must be in the first body segment");
+    assert (FdCount() == msg.FdCount() && "passed fd arrays must be marshalled with their element count");
+    if (Segments().empty() && _body.capacity()) {
+	assert (_body.capacity() >= _h.sz && "message body must be created aligned to Msg::Alignment::Body");
+	_body.memlink::resize (_h.sz);
+    }	// segmented and linked bodies are padded in WriteIOVecs
 }
 
-uint8_t Extern::ExtMsg::WriteHeaderStrings (methodid_t method) noexcept
+streamsize Extern::ExtMsg::SegmentsSize (void) const noexcept
 {
-    // _hbuf contains iface\0method\0signature\0, padded to Msg::Alignment::Header
+    streamsize sz = 0;
+    for (auto& s : Segments())
+	sz += s.size();
+    return sz;
+}
+
+uint8_t Extern::ExtMsg::HeaderSizeFor (methodid_t method, bool hasreqid) noexcept // static
+{
+    // The header strings are iface\0method\0signature\0, padded to Msg::Alignment::Header
+    // They follow the request id, if there is one.
     auto iface = InterfaceOfMethod (method);
-    assert (ptrdiff_t(sizeof(_hbuf)) >= InterfaceNameSize(iface)+MethodNextOffset(method)-2 && "the interface and method names for this message are too long to export");
-    ostream os (_hbuf, sizeof(_hbuf));
-    os.write (iface, InterfaceNameSize(iface));
-    os.write (method, MethodNextOffset(method)-2);
-    os.align (Msg::Alignment::Header);
-    return sizeof(_h) + distance (_hbuf, os.ptr());
+    streamsize strsz = InterfaceNameSize(iface)+MethodNextOffset(method)-2;
+    if (hasreqid)
+	strsz += sizeof(Msg::reqid_t);
+    assert (c_MaxHeaderSize >= strsz && "the interface and method names for this message are too long to export");
+    return Align (sizeof(_h) + strsz, Msg::Alignment::Header);
 }
 
-void Extern::ExtMsg::WriteIOVecs (iovec* iov, streamsize bw) noexcept
+unsigned Extern::ExtMsg::WriteIOVecs (iovec* iov, streamsize bw, unsigned maxiov) noexcept
 {
-    // Setup the two iovecs, 0 for header, 1 for body
-    // bw is the bytes already written in previous sendmsg call
-    auto hp = HeaderPtr();	// char* to full header
-    auto hsz = _h.hsz + sizeof(_h)*!_h.hsz;
-    if (bw < hsz) {	// still need to write header
-	hsz -= bw;
-	hp += bw;
-	bw = 0;
-    } else {		// header already written
-	bw -= hsz;
-	hp = nullptr;
-	hsz = 0;
+    // Setup the iovecs for the fixed header, the request id, the interface
+    // and method strings from the interface block, and the padding after them.
+    // The body follows, with one iovec for each body segment and one
+    // for the padding after the last segment. bw is the bytes already
+    // written in previous sendmsg call, skipped here along with empty
+    // pieces. Pieces beyond maxiov are omitted, and will be written by
+    // a later call.
+    assert (maxiov >= 2);
+    auto niov = 0u;
+    auto addpiece = [&](const void* p, streamsize n) {
+	auto sk = min (bw, n);
+	bw -= sk;
+	if (sk == n || niov >= maxiov)
+	    return;	// already written, or does not fit
+	iov[niov].iov_base = const_cast<char*>(static_cast<const char*>(p)+sk);
+	iov[niov++].iov_len = n - sk;
+    };
+    static const char c_Padding [Msg::Alignment::Body] = {};
+    static_assert (Msg::Alignment::Header <= sizeof(c_Padding), "c_Padding must also pad the header");
+
+    auto iface = InterfaceOfMethod (_method);
+    streamsize ifacesz = InterfaceNameSize (iface), methodsz = MethodNextOffset(_method)-2;
+    streamsize reqidsz = HasRequestId() ? sizeof(_reqid) : 0;
+    addpiece (&_h, sizeof(_h));
+    addpiece (&_reqid, reqidsz);
+    addpiece (iface, ifacesz);
+    addpiece (_method, methodsz);
+    addpiece (c_Padding, HeaderSize() - (sizeof(_h)+reqidsz+ifacesz+methodsz));
+
+    streamsize sz = _body.size();
+    addpiece (_body.data(), sz);
+    for (auto& s : Segments()) {
+	addpiece (s.data(), s.size());
+	sz += s.size();
     }
-    iov[0].iov_base = hp;
-    iov[0].iov_len = hsz;
-    iov[1].iov_base = _body.iat(bw);
-    iov[1].iov_len = _h.sz - bw;
+    addpiece (c_Padding, _h.sz - sz);
+    return niov;
+}
+
+void Extern::ExtMsg::ReadIOVecs (iovec* iov, streamsize br) noexcept
+{
+    // Setup two iovecs for the rest of a received message, the header
+    // and the body, with br bytes already read. Until the fixed header
+    // is read, the sizes are unknown, and only it is read.
+    if (br < sizeof(_h)) {
+	iov[0] = { reinterpret_cast<char*>(&_h)+br, sizeof(_h)-br };
+	iov[1] = {};
+	return;
+    }
+    br -= sizeof(_h);
+    auto hr = min (br, _hstr.size());
+    iov[0] = { _hstr.iat(hr), size_t(_hstr.size()-hr) };
+    br -= hr;
+    iov[1] = { _body.iat(br), size_t(_body.size()-br) };
+}
+
+void Extern::ExtMsg::Compress (void) noexcept
+{
+    // Compression is not worth it for small bodies. Passed fds are
+    // written into the body, so those bodies also remain uncompressed.
+    if (BodySize() < c_MinCompressSize || HasFd() || IsCompressed())
+	return;
+
+    // Segmented and linked bodies are compressed from a gathered copy
+    memblock gbuf;
+    cmemlink src (_body.data(), BodySize());
+    if (!IsContiguous()) {
+	gbuf.resize (BodySize());
+	auto p = copy_n (_body.data(), _body.size(), gbuf.data());
+	for (auto& seg : Segments())
+	    p = copy_n (seg.data(), seg.size(), p);
+	fill (p, gbuf.end(), 0);
+	src = gbuf;
+    }
+
+    // Compressed body is prefixed by the uncompressed and compressed sizes
+    enum { c_PrefixSize = 2*sizeof(uint32_t) };
+    memblock cbody (c_PrefixSize + BodySize());
+    auto csz = lz_compress (src.data(), src.size(), cbody.iat(c_PrefixSize), cbody.size()-c_PrefixSize);
+    auto cbodysz = Align (c_PrefixSize+csz, Msg::Alignment::Body);
+    if (!csz || cbodysz > BodySize()-BodySize()/8)
+	return;	// not enough compression to be worthwhile
+    ostream os (cbody.data(), c_PrefixSize);
+    os << uint32_t(BodySize()) << uint32_t(csz);
+    fill (cbody.iat(c_PrefixSize+csz), cbody.iat(cbodysz), 0);
+    cbody.memlink::resize (cbodysz);
+
+    _body.swap (move (cbody));
+    _chain.reset();
+    _h.sz = cbodysz;
+    _h.flags |= BitMask (hf_Compressed);
+}
+
+bool Extern::ExtMsg::Decompress (void) noexcept
+{
+    auto is = Read();
+    if (is.remaining() < 2*sizeof(uint32_t))
+	return false;
+    auto rawsz = is.readv<uint32_t>();
+    auto csz = is.readv<uint32_t>();
+    if (rawsz > c_MaxBodySize || !IsAligned (rawsz, Msg::Alignment::Body) || csz > is.remaining())
+	return false;
+    memblock rbody (rawsz);
+    if (rawsz != lz_decompress (is.ptr<char>(), csz, rbody.data(), rbody.size()))
+	return false;
+    _body.swap (move (rbody));
+    _h.sz = rawsz;
+    _h.flags &= ~BitMask (hf_Compressed);
+    return true;
 }
 
-auto Extern::ExtMsg::PassedFd (void) const noexcept -> fd_t
+unsigned Extern::ExtMsg::FdCount (void) const noexcept
+{
+    if (!HasFd())
+	return 0;
+    else if (!HasFdArray())
+	return 1;
+    else if (_h.fdoffset < sizeof(uint32_t) || _h.fdoffset > _body.size())
+	return 0;	// only possible in an invalid received message
+    istream is (_body.iat(_h.fdoffset-sizeof(uint32_t)), sizeof(uint32_t));
+    return is.readv<uint32_t>();
+}
+
+auto Extern::ExtMsg::PassedFd (unsigned i) const noexcept -> fd_t
 {
     if (!HasFd())
 	return -1;
-    istream fdis (_body.iat(_h.fdoffset), sizeof(int));
-    return fdis.readv<int>();
+    istream fdis (_body.iat(_h.fdoffset+i*sizeof(fd_t)), sizeof(fd_t));
+    return fdis.readv<fd_t>();
+}
+
+auto Extern::ExtMsg::RequestId (void) const noexcept -> Msg::reqid_t
+{
+    if (!HasRequestId() || _hstr.size() < sizeof(Msg::reqid_t))
+	return Msg::NoRequest;
+    istream is (_hstr.data(), sizeof(Msg::reqid_t));
+    return is.readv<Msg::reqid_t>();
 }
 
 methodid_t Extern::ExtMsg::ParseMethod (void) const noexcept
 {
-    streamsize ssz = _h.hsz-sizeof(_h);
-    auto ifacename = _hbuf;
+    streamsize ssz = _hstr.size();
+    auto ifacename = _hstr.data();
+    if (HasRequestId()) {	// the request id precedes the strings
+	if (ssz < streamsize(sizeof(Msg::reqid_t)))
+	    return nullptr;
+	ifacename += sizeof(Msg::reqid_t);
+	ssz -= sizeof(Msg::reqid_t);
+    }
     auto methodname = strnext_r (ifacename, ssz);
     if (!ssz)
 	return nullptr;
@@ -362,15 +805,270 @@ void Extern::ExtMsg::DebugDump (void) const noexcept
 {
     if (DEBUG_MSG_TRACE) {
 	DEBUG_PRINTF ("[X] Message for extid %u of size %u completed:\n", _h.extid, _h.sz);
-	hexdump (HeaderPtr(), _h.hsz);
+	hexdump (&_h, sizeof(_h));
+	hexdump (_hstr.data(), _hstr.size());
 	hexdump (_body.data(), _body.size());
+	for (auto& s : Segments())
+	    hexdump (s.data(), s.size());
+    }
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ Extern::OutQueue
+
+// Messages are queued ahead of those of lower priority, except those
+// before minpos, and those on the same link, to keep the link ordered.
+auto Extern::OutQueue::emplace_back (Msg&& msg, size_type minpos) noexcept -> ExtMsg&
+{
+    auto i = size();
+    while (i > minpos && _q[_f+i-1].GetPriority() < msg.GetPriority() && _q[_f+i-1].Extid() != msg.Extid())
+	--i;
+    if (i == size())
+	return _q.emplace_back (move (msg));
+    return *_q.emplace (_q.iat(_f+i), move (msg));
+}
+
+auto Extern::OutQueue::emplace_front (Msg&& msg) noexcept -> ExtMsg&
+{
+    return *_q.emplace (_q.iat(_f), move (msg));
+}
+
+void Extern::OutQueue::pop_front (size_type n) noexcept
+{
+    assert (n <= size());
+    for (auto i = _f; i < _f+n; ++i) {	// release the written bodies
+	destroy_at (&_q[i]);
+	construct_at (&_q[i]);
+    }
+    _f += n;
+    if (_f == _q.size()) {
+	_q.clear();
+	_f = 0;
+    } else if (_f >= size()) {
+	_q.erase (_q.begin(), _f);
+	_f = 0;
     }
 }
 
+//}}}-------------------------------------------------------------------
+//{{{ Extern::ShmRing
+
+auto Extern::ShmRing::Create (void) noexcept -> fd_t
+{
+    auto fd = memfd_create ("cwiclo.ring", MFD_CLOEXEC| MFD_ALLOW_SEALING);
+    if (fd < 0)
+	return fd;
+    // The size is sealed to prevent SIGBUS in the reader on truncation
+    if (0 > ftruncate (fd, c_MapSize)
+	    || 0 > fcntl (fd, F_ADD_SEALS, F_SEAL_SHRINK| F_SEAL_GROW| F_SEAL_SEAL)
+	    || !Map (fd)) {
+	close (fd);
+	return -1;
+    }
+    return fd;
+}
+
+bool Extern::ShmRing::Attach (fd_t fd) noexcept
+{
+    // The ring must be of the expected size, sealed to remain so
+    struct stat st;
+    auto seals = fcntl (fd, F_GET_SEALS);
+    bool ok = !fstat (fd, &st) && st.st_size == c_MapSize
+	    && seals >= 0 && (seals & (F_SEAL_SHRINK| F_SEAL_GROW)) == (F_SEAL_SHRINK| F_SEAL_GROW)
+	    && Map (fd);
+    close (fd);	// the mapping remains valid
+    return ok;
+}
+
+bool Extern::ShmRing::Map (fd_t fd) noexcept
+{
+    assert (!IsOpen());
+    auto p = mmap (nullptr, c_MapSize, PROT_READ| PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+	return false;
+    _h = static_cast<Header*>(p);
+    return true;
+}
+
+void Extern::ShmRing::Close (void) noexcept
+{
+    if (IsOpen())
+	munmap (exchange (_h, nullptr), c_MapSize);
+}
+
+ssize_t Extern::ShmRing::Write (const iovec* iov, unsigned niov) noexcept
+{
+    uint32_t tail = _h->tail, used = Used();
+    if (used > c_Capacity)
+	return -1;	// corrupted by the reader
+    auto d = Data();
+    ssize_t bw = 0;
+    for (auto i = 0u; i < niov && used < c_Capacity; ++i) {
+	uint32_t n = min (iov[i].iov_len, size_t(c_Capacity-used));
+	auto p = static_cast<const char*>(iov[i].iov_base);
+	auto o = tail % c_Capacity, n1 = min (n, c_Capacity-o);
+	copy_n (p, n1, d+o);
+	copy_n (p+n1, n-n1, d);
+	tail += n;
+	used += n;
+	bw += n;
+    }
+    __atomic_store_n (&_h->tail, tail, __ATOMIC_RELEASE);
+    return bw;
+}
+
+ssize_t Extern::ShmRing::Read (const iovec* iov, unsigned niov) noexcept
+{
+    uint32_t head = _h->head, used = Used();
+    if (used > c_Capacity)
+	return -1;	// corrupted by the writer
+    auto d = Data();
+    ssize_t br = 0;
+    for (auto i = 0u; i < niov && used; ++i) {
+	uint32_t n = min (iov[i].iov_len, size_t(used));
+	auto p = static_cast<char*>(iov[i].iov_base);
+	auto o = head % c_Capacity, n1 = min (n, c_Capacity-o);
+	copy_n (d+o, n1, p);
+	copy_n (d, n-n1, p+n1);
+	head += n;
+	used -= n;
+	br += n;
+    }
+    __atomic_store_n (&_h->head, head, __ATOMIC_RELEASE);
+    return br;
+}
+
+// Waiting flags are set before rechecking the ring, and checked by
+// the other side after updating its position, so neither side can miss
+// the other's update. Returns true if there is still nothing to do.
+//
+bool Extern::ShmRing::WaitForWriter (void) noexcept
+{
+    __atomic_store_n (&_h->readerWaiting, true, __ATOMIC_SEQ_CST);
+    if (!Used())
+	return true;
+    __atomic_store_n (&_h->readerWaiting, false, __ATOMIC_RELAXED);
+    return false;
+}
+
+bool Extern::ShmRing::WaitForReader (void) noexcept
+{
+    __atomic_store_n (&_h->writerWaiting, true, __ATOMIC_SEQ_CST);
+    if (Used() >= c_Capacity)
+	return true;
+    __atomic_store_n (&_h->writerWaiting, false, __ATOMIC_RELAXED);
+    return false;
+}
+
+// Clears the other side's waiting flag, returning true if it was set
+bool Extern::ShmRing::Woken (uint32_t& f) noexcept // static
+{
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    return __atomic_load_n (&f, __ATOMIC_RELAXED) && __atomic_exchange_n (&f, false, __ATOMIC_ACQ_REL);
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ Extern::SpliceStream
+
+bool Extern::SpliceStream::OpenPipe (void) noexcept
+{
+    if (0 > pipe2 (_pipe, O_NONBLOCK| O_CLOEXEC))
+	return false;
+    // A larger pipe moves more data per splice call. The limit for
+    // unprivileged processes may be lower, and then the default is used.
+    fcntl (_pipe[1], F_SETPIPE_SZ, int(c_PipeSize));
+    auto sz = fcntl (_pipe[1], F_GETPIPE_SZ);
+    _pipesz = sz > 0 ? sz : PIPE_BUF;
+    return true;
+}
+
+void Extern::SpliceStream::ClosePipe (void) noexcept
+{
+    for (auto& p : _pipe)
+	if (p >= 0)
+	    close (exchange (p, -1));
+    _inpipe = 0;
+}
+
+// Sets the local fd, returning the previous one
+auto Extern::SpliceStream::SetFd (fd_t fd) noexcept -> fd_t
+{
+    if (exchange (_blocked, false))
+	_timer.Stop();
+    return exchange (_fd, fd);
+}
+
+void Extern::SpliceStream::Finish (void) noexcept
+{
+    if (exchange (_blocked, false))
+	_timer.Stop();
+    if (_inpipe)	// of an unfinished stream
+	ClosePipe();
+    _left = 0;
+}
+
+// Returns the status for waiting on fd, watching it if it is local
+auto Extern::SpliceStream::Wait (fd_t fd, PTimer::WatchCmd cmd) noexcept -> Status
+{
+    if (fd != _fd)
+	return Status::WaitSocket;
+    _blocked = true;
+    _timer.Watch (cmd, fd);
+    return Status::WaitLocal;
+}
+
+// Moves the remaining data from one fd to the other, through the pipe,
+// until all is moved, or one of them must be waited for.
+auto Extern::SpliceStream::Transfer (fd_t from, fd_t to) noexcept -> Status
+{
+    if (_pipe[0] < 0 && !OpenPipe())
+	return Status::Failed;
+    while (_left) {
+	if (!_inpipe) {
+	    auto n = splice (from, nullptr, _pipe[1], nullptr, min (_left, uint64_t(_pipesz)), SPLICE_F_MOVE| SPLICE_F_NONBLOCK);
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    if (n < 0 && errno == EAGAIN)
+		return Wait (from, PTimer::WatchCmd::Read);
+	    if (n <= 0)
+		return n ? Status::Failed : Status::Ended;
+	    _inpipe = n;
+	}
+	auto n = splice (_pipe[0], nullptr, to, nullptr, _inpipe, SPLICE_F_MOVE| SPLICE_F_NONBLOCK| (_left > _inpipe ? SPLICE_F_MORE : 0));
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0 && errno == EAGAIN)
+	    return Wait (to, PTimer::WatchCmd::Write);
+	if (n <= 0)
+	    return Status::Failed;
+	_inpipe -= n;
+	_left -= n;
+    }
+    return Status::Done;
+}
+
+// Writes data already received with the preceding message to the local
+// fd, returning the number of bytes written in nw.
+auto Extern::SpliceStream::Write (const char* p, streamsize n, streamsize& nw) noexcept -> Status
+{
+    for (nw = 0; nw < n && _left;) {
+	auto bw = write (_fd, p+nw, min (uint64_t(n-nw), _left));
+	if (bw < 0 && errno == EINTR)
+	    continue;
+	if (bw < 0 && errno == EAGAIN)
+	    return Wait (_fd, PTimer::WatchCmd::Write);
+	if (bw <= 0)
+	    return Status::Failed;
+	nw += bw;
+	_left -= bw;
+    }
+    return Status::Done;
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ Extern::Extern
 
-void Extern::Extern_Open (fd_t fd, const iid_t* eifaces, PExtern::SocketSide side) noexcept
+void Extern::Extern_Open (fd_t fd, const iid_t* eifaces, PExtern::SocketSide side, PExtern::Compression compression, PExtern::Transport transport) noexcept
 {
     if (!AttachToSocket (fd))
 	return Error ("invalid socket type");
@@ -378,22 +1076,216 @@ void Extern::Extern_Open (fd_t fd, const iid_t* eifaces, PExtern::SocketSide sid
     _einfo.exported = eifaces;
     _einfo.side = side;
     EnableCredentialsPassing (true);
-    // Initial handshake is an exchange of COM::Export messages
-    QueueOutgoing (PCOM::ExportMsg (extid_COM, eifaces));
+    SetFlag (f_OfferCompression, compression == PExtern::Compression::On
+	    || (compression == PExtern::Compression::Auto && !_einfo.isUnixSocket));
+    SetFlag (f_OfferRing, transport == PExtern::Transport::Auto && _einfo.isUnixSocket && !_einfo.isSeqPacket);
+    QueueOutgoing (ExportMsg());
+}
+
+// Initial handshake is an exchange of COM::Export messages,
+// with capability tokens appended to the interface list.
+Msg Extern::ExportMsg (void) const noexcept
+{
+    auto elist = PCOM::StringFromInterfaceList (_einfo.exported);
+    auto offer = [&](const char* token) {
+	if (!elist.empty())
+	    elist += ',';
+	elist += token;
+    };
+    if (Flag (f_OfferCompression))
+	offer (c_CompressionToken);
+    if (Flag (f_OfferRing))
+	offer (c_RingToken);
+    offer (c_ExtendedToken);
+    return PCOM::ExportMsg (extid_COM, elist);
 }
 
 void Extern::Extern_Close (void) noexcept
 {
+    // Messages queued before Close are written, if the socket takes them
+    if (!Flag (f_Unused) && _sockfd >= 0) {
+	SetFlag (f_Unused);
+	WriteOutgoing();
+    }
     SetFlag (f_Unused);
+    _peeraddrlen = 0;	// not to reconnect
     close (exchange (_sockfd, -1));
+    if (_capfd >= 0)
+	close (exchange (_capfd, -1));
+    for (auto fd : _infds)	// received for messages that will not arrive
+	close (fd);
+    _infds.clear();
+    CancelSplices();
+    if (auto fd = _splicein.SetFd (-1); fd >= 0)
+	close (fd);
+}
+
+void Extern::Extern_Flush (void) noexcept
+{
+    SetFlag (f_FlushQueued, false);
+    if (_sockfd < 0)
+	return;
+    // Writing to shared memory does not require waiting for the socket
+    if (_txring.IsOpen() && !_nsockmsgs && !WriteOutgoingRing())
+	return;
+    // While corked, written until the queue is empty,
+    // and then pushed out of the corked TCP socket.
+    SetFlag (f_Flushing, Flag (f_Corked));
+    TimerR_Timer (_sockfd);
+    if (Flag (f_Corked) && !Flag (f_Flushing)) {
+	SetTcpCork (false);
+	SetTcpCork (true);
+    }
+}
+
+void Extern::Extern_Cork (bool corked) noexcept
+{
+    if (corked == Flag (f_Corked))
+	return;
+    SetFlag (f_Corked, corked);
+    SetTcpCork (corked);
+    if (!corked)
+	Extern_Flush();
+}
+
+void Extern::Extern_KeepAlive (uint32_t intervalms, uint32_t timeoutms) noexcept
+{
+    _pinginterval = intervalms;
+    _deadtimeout = max (timeoutms, intervalms);
+    _lastheard = _lastping = PTimer::Now();
+    if (_sockfd >= 0)
+	TimerR_Timer (_sockfd);	// to set the timeout
+}
+
+void Extern::Extern_Reconnect (uint32_t maxbuffered) noexcept
+{
+    if (_einfo.side != PExtern::SocketSide::Client)
+	return Error ("only client connections can reconnect");
+    // The peer address is saved when the connection is established
+    _maxbuffered = maxbuffered;
+    _redialdelay = c_MinRedialDelay;
+}
+
+void Extern::Extern_Capture (fd_t fd) noexcept
+{
+    if (_capfd >= 0)
+	close (_capfd);
+    _capfd = fd;
+    _lastcap = NowUs();
+}
+
+// The data follows a COM Stream message on the socket, so the message
+// queue is not written until it is. The source is taken in WriteOutgoing
+// when the stream message is written.
+void Extern::Extern_Splice (fd_t fd, uint64_t size) noexcept
+{
+    if (Flag (f_OfferRing) || _einfo.isSeqPacket) {
+	close (fd);
+	return Error ("splicing requires a stream socket transport");
+    }
+    if (!size) {
+	close (fd);
+	return;
+    }
+    _splicesrc.push_back (SpliceSource { fd, size });
+    QueueOutgoing (PCOM::StreamMsg (extid_COM, size));
+}
+
+// Replaces the destination of received data, including the rest of
+// data being received.
+void Extern::Extern_SpliceTo (fd_t fd) noexcept
+{
+    if (auto ofd = _splicein.SetFd (fd); ofd >= 0)
+	close (ofd);
+}
+
+// Stops sending and receiving spliced data, which can not be resumed
+void Extern::CancelSplices (void) noexcept
+{
+    _spliceout.Finish();
+    if (auto fd = _spliceout.SetFd (-1); fd >= 0)
+	close (fd);
+    for (auto& s : _splicesrc)
+	close (s.fd);
+    _splicesrc.clear();
+    _splicein.Finish();
+}
+
+// Called when the connection is lost. Without reconnect, the Extern
+// is closed. With it, the connection state is reset, and the peer is
+// redialed after the backoff delay.
+//
+void Extern::Disconnect (void) noexcept
+{
+    if (!_peeraddrlen)
+	return Extern_Close();
+    DEBUG_PRINTF ("[X] %hu.Extern: connection lost, reconnecting in %u ms\n", MsgerId(), _redialdelay);
+    close (exchange (_sockfd, -1));
+    for (auto fd : _infds)
+	close (fd);
+    _infds.clear();
+    _inmsg.SetHeader ({});
+    _bread = 0;
+    _rbuf.clear();
+    _rbufp = 0;
+    _txring.Close();
+    _rxring.Close();
+    _nsockmsgs = 0;
+    _einfo.isSharedMemory = false;
+    _einfo.creds = {};	// received again from the new connection
+    CancelSplices();	// their stream messages are removed below
+
+    // A partially written message is written again from the start,
+    // unless its fds were already passed. COM messages, and messages
+    // to objects created by the peer, are for the lost connection.
+    _bwritten = 0;
+    auto peerextid = [&](mrid_t extid)
+	{ return (extid >= extid_ServerBase) != bool(_einfo.side); };
+    _outq.remove_if ([&](const ExtMsg& m) {
+	return InterfaceOfMethod (m.Method()) == PCOM::Interface()
+	    || peerextid (m.Extid())
+	    || (m.HasFd() && !m.UnsentFdCount());
+    });
+    // Objects created by the peer are deleted, since their callers are
+    // gone. Relays of local callers remain, to recreate remote objects.
+    for (auto& r : _relays)
+	if (r.extid != extid_COM && peerextid (r.extid))
+	    r.relay.Delete();
+
+    // Randomized, so that clients of a restarted server do not all
+    // reconnect at the same time.
+    auto jitter = (uint32_t(getpid())*2654435761u ^ uint32_t(PTimer::Now())) % (_redialdelay/2+1);
+    _timer.Timer (_redialdelay/2 + jitter);
+}
+
+void Extern::Redial (void) noexcept
+{
+    auto fd = PExtern::ConnectSocket (reinterpret_cast<const sockaddr*>(&_peeraddr), _peeraddrlen,
+					_einfo.isSeqPacket ? SOCK_SEQPACKET : SOCK_STREAM);
+    if (fd < 0 || !AttachToSocket (fd)) {
+	if (fd >= 0)
+	    close (fd);
+	_redialdelay = min (_redialdelay*2, uint32_t(c_MaxRedialDelay));
+	DEBUG_PRINTF ("[X] %hu.Extern: failed to reconnect, retrying in %u ms\n", MsgerId(), _redialdelay);
+	return _timer.Timer (_redialdelay);
+    }
+    DEBUG_PRINTF ("[X] %hu.Extern: reconnected on socket %d\n", MsgerId(), fd);
+    _sockfd = fd;
+    EnableCredentialsPassing (true);
+    _lastheard = _lastping = PTimer::Now();
+    // The handshake must precede the buffered messages
+    _outq.emplace_front (ExportMsg());
+    SetTcpCork (Flag (f_Corked));
+    SetFlag (f_Flushing, Flag (f_Corked));	// the handshake is not held
+    TimerR_Timer (_sockfd);
 }
 
 bool Extern::AttachToSocket (fd_t fd) noexcept
 {
-    // The incoming socket must be a stream socket
+    // The incoming socket must be a stream socket, or a packet socket
     int v;
     socklen_t l = sizeof(v);
-    if (getsockopt (fd, SOL_SOCKET, SO_TYPE, &v, &l) < 0 || v != SOCK_STREAM)
+    if (getsockopt (fd, SOL_SOCKET, SO_TYPE, &v, &l) < 0 || (v != SOCK_STREAM && v != SOCK_SEQPACKET))
 	return false;
 
     // And it must match the family (PF_LOCAL or PF_INET)
@@ -407,14 +1299,37 @@ bool Extern::AttachToSocket (fd_t fd) noexcept
     else if (ss.ss_family != PF_INET)
 	return false;
 
-    // If matches, need to set the fd nonblocking for the poll loop to work
+    // Packets are supported only on UNIX sockets, where they are reliable
+    _einfo.isSeqPacket = v == SOCK_SEQPACKET;
+    if (_einfo.isSeqPacket && !_einfo.isUnixSocket)
+	return false;
+
+    // If matches, need to set the fd nonblocking for the poll loop to work.
+    // Sockets from ExternServer are already nonblocking.
     if (auto f = fcntl (fd, F_GETFL); f < 0)
 	return false;
-    else if (0 > fcntl (fd, F_SETFL, f| O_NONBLOCK| O_CLOEXEC))
+    else if (!(f & O_NONBLOCK) && 0 > fcntl (fd, F_SETFL, f| O_NONBLOCK))
 	return false;
+
+    // Messages are batched before writing, so Nagle's algorithm would
+    // only delay them. Failing to disable it is not fatal.
+    if (!_einfo.isUnixSocket) {
+	int nodelay = true;
+	setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
     return true;
 }
 
+// Sets TCP_CORK on a TCP socket, holding partial segments until cleared
+void Extern::SetTcpCork (bool corked) noexcept
+{
+    if (_sockfd < 0 || _einfo.isUnixSocket)
+	return;
+    int sov = corked;
+    if (0 > setsockopt (_sockfd, IPPROTO_TCP, TCP_CORK, &sov, sizeof(sov)))
+	return ErrorLibc ("setsockopt(TCP_CORK)");
+}
+
 void Extern::EnableCredentialsPassing (bool enable) noexcept
 {
     if (_sockfd < 0 || !_einfo.isUnixSocket)
@@ -436,8 +1351,10 @@ void Extern::COM_Error (const lstring& errmsg) noexcept
 void Extern::COM_Export (string elist) noexcept
 {
     // Other side of the socket listing exported interfaces as a comma-separated list
+    UnindexImports();
     _einfo.imported.clear();
-    foreach (ei, elist) {
+    SetFlag (f_PeerExtended, false);
+    for (auto ei = elist.begin(); ei < elist.end();) {
 	auto eic = elist.find (',', ei);
 	if (!eic)
 	    eic = elist.end();
@@ -445,8 +1362,28 @@ void Extern::COM_Export (string elist) noexcept
 	auto iid = App::InterfaceByName (ei, eic-ei);
 	if (iid)	// _einfo.imported only contains interfaces supported by this App
 	    _einfo.imported.push_back (iid);
+	else if (eic-ei == sizeof(c_CompressionToken) && 0 == memcmp (ei, c_CompressionToken, sizeof(c_CompressionToken)))
+	    _einfo.isCompressed = Flag (f_OfferCompression);
+	else if (eic-ei == sizeof(c_RingToken) && 0 == memcmp (ei, c_RingToken, sizeof(c_RingToken)) && Flag (f_OfferRing))
+	    OpenRing();
+	else if (eic-ei == sizeof(c_ExtendedToken) && 0 == memcmp (ei, c_ExtendedToken, sizeof(c_ExtendedToken)))
+	    SetFlag (f_PeerExtended);
 	ei = eic;
     }
+    IndexImports();
+    // Reconnecting requires the peer address, available once connected
+    if (_maxbuffered && !_peeraddrlen) {
+	_peeraddrlen = sizeof(_peeraddr);
+	if (0 > getpeername (_sockfd, reinterpret_cast<sockaddr*>(&_peeraddr), &_peeraddrlen)
+		|| _peeraddrlen <= sizeof(_peeraddr.ss_family)) {	// unnamed, as from socketpair
+	    DEBUG_PRINTF ("[XE] %hu.Extern: peer address is unavailable for reconnecting\n", MsgerId());
+	    _peeraddrlen = 0;
+	}
+    }
+    _redialdelay = c_MinRedialDelay;
+    // Keepalive starts when the peer is known to answer pings
+    if (_pinginterval && Flag (f_PeerExtended) && _sockfd >= 0)
+	TimerR_Timer (_sockfd);
     _reply.Connected (&_einfo);
 }
 
@@ -456,96 +1393,444 @@ void Extern::COM_Delete (void) noexcept
     SetFlag (f_Unused);
 }
 
+//}}}-------------------------------------------------------------------
+//{{{ Extern::Ring
+
+// Fds are passed in one SCM_RIGHTS array. fdbuf must have space for
+// CMSG_SPACE of the fds, and the kernel counts them from cmsg_len.
+static void SetPassedFdsCmsg (msghdr& mh, char* fdbuf, const int* fds, unsigned nfds)
+{
+    mh.msg_control = fdbuf;
+    mh.msg_controllen = CMSG_SPACE (nfds*sizeof(int));
+    auto cmsg = CMSG_FIRSTHDR(&mh);
+    cmsg->cmsg_len = CMSG_LEN (nfds*sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    ostream fdos ((ostream::pointer) CMSG_DATA (cmsg), nfds*sizeof(int));
+    for (auto i = 0u; i < nfds; ++i)
+	fdos << fds[i];
+}
+
+void Extern::OpenRing (void) noexcept
+{
+    if (_txring.IsOpen())
+	return;
+    auto fd = _txring.Create();
+    if (fd < 0) {	// the socket continues to be used
+	DEBUG_PRINTF ("[X] %hu.Extern: failed to create shared memory ring: %s\n", MsgerId(), strerror(errno));
+	return;
+    }
+    // The ring fd is passed in the last message written to the socket.
+    // Messages queued after it are written to the ring. The other side
+    // switches to reading the ring when it receives this message.
+    _nsockmsgs = _outq.size()+1;
+    _einfo.isSharedMemory = true;
+    QueueOutgoing (PCOM::RingMsg (extid_COM, fd));
+}
+
+// Attaches the sender's ring. Messages following this one are in it.
+bool Extern::AttachRing (void) noexcept
+{
+    auto fd = _inmsg.PassedFd();
+    if (_inmsg.Extid() != extid_COM || !Flag (f_OfferRing) || _rxring.IsOpen()) {
+	if (fd >= 0)
+	    close (fd);
+	return false;
+    }
+    DEBUG_PRINTF ("[X] %hu.Extern: reading from shared memory ring\n", MsgerId());
+    return _rxring.Attach (fd);
+}
+
+// In ring mode, a byte written to the socket wakes up the other side.
+// Passed fds are sent the same way, before their messages are written
+// to the ring. Returns false if the socket is full or closed.
+//
+bool Extern::SendWakeup (const fd_t* fds, unsigned nfds) noexcept
+{
+    char b = 0;
+    iovec iov = { &b, sizeof(b) };
+    msghdr mh = {};
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    char fdbuf [CMSG_SPACE(c_MaxPassedFds*sizeof(fd_t))] = {};
+    if (nfds)
+	SetPassedFdsCmsg (mh, fdbuf, fds, nfds);
+    for (;;) {
+	if (0 < sendmsg (_sockfd, &mh, MSG_NOSIGNAL))
+	    return true;
+	if (errno == EINTR)
+	    continue;
+	if (errno == EAGAIN)
+	    return false;	// unread wakeups are already there
+	if (errno != ECONNRESET && errno != EPIPE)
+	    ErrorLibc ("sendmsg");
+	Disconnect();
+	return false;
+    }
+}
+
+// In ring mode, the socket is read only for wakeups, fds, and credentials.
+// Reading stops when at least minfds received fds are queued, so that
+// the queue does not grow beyond what the next messages need.
+// Returns false if the socket was closed.
+//
+bool Extern::ReadWakeups (unsigned minfds) noexcept
+{
+    while (_infds.size() < minfds) {
+	char buf [64];
+	iovec iov = { buf, sizeof(buf) };
+	char cmsgbuf [CMSG_SPACE(c_MaxPassedFds*sizeof(fd_t)) + CMSG_SPACE(sizeof(ucred))] = {};
+	msghdr mh = {};
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cmsgbuf;
+	mh.msg_controllen = sizeof(cmsgbuf);
+	if (auto rmr = recvmsg (_sockfd, &mh, 0); rmr <= 0) {
+	    if (!rmr || errno == ECONNRESET)
+		DEBUG_PRINTF ("[X] %hu.Extern: rsocket %d closed by the other end\n", MsgerId(), _sockfd);
+	    else if (errno == EINTR)
+		continue;
+	    else if (errno == EAGAIN)
+		break;
+	    else
+		ErrorLibc ("recvmsg");
+	    Disconnect();
+	    return false;
+	}
+	if (!ReceiveAncillary (mh))
+	    return false;
+    }
+    return true;
+}
+
 //}}}-------------------------------------------------------------------
 //{{{ Extern::Timer
 
-void Extern::TimerR_Timer (fd_t) noexcept
+void Extern::TimerR_Timer (fd_t fd) noexcept
 {
+    if (_sockfd < 0 && fd < 0 && _peeraddrlen)
+	return Redial();	// the backoff timer has fired
+    if (fd >= 0 && fd != _sockfd) {	// a spliced fd is ready
+	_spliceout.Ready (fd);
+	_splicein.Ready (fd);
+    }
     if (_sockfd >= 0)
 	ReadIncoming();
-    auto tcmd = PTimer::WatchCmd::Read;
-    if (_sockfd >= 0 && WriteOutgoing())
-	tcmd = PTimer::WatchCmd::ReadWrite;
+    auto timeout = PTimer::TimerNone;
+    if (_sockfd >= 0)
+	timeout = KeepAliveTimeout();
+    // While received data waits for its destination, the socket is not read
+    // While corked, only a flush is written
+    auto tcmd = _splicein.IsBlocked() ? PTimer::WatchCmd::Timer : PTimer::WatchCmd::Read;
+    if (_sockfd >= 0 && (!Flag (f_Corked) || Flag (f_Flushing))) {
+	if (WriteOutgoing())
+	    tcmd = _splicein.IsBlocked() ? PTimer::WatchCmd::WriteTimer : PTimer::WatchCmd::ReadWrite;
+	else
+	    SetFlag (f_Flushing, false);
+    }
     if (_sockfd >= 0)
-	_timer.Watch (tcmd, _sockfd);
+	_timer.Watch (tcmd, _sockfd, timeout);
+}
+
+// Pings the peer when nothing was received from it for the keepalive
+// interval, and closes the connection when nothing was received for
+// the timeout. Returns the time until the next check. Peers that do
+// not offer c_ExtendedToken can not answer pings, and are not checked.
+//
+PTimer::mstime_t Extern::KeepAliveTimeout (void) noexcept
+{
+    if (!_pinginterval || !Flag (f_PeerExtended))
+	return PTimer::TimerNone;
+    auto now = PTimer::Now();
+    if (Flag (f_Heard)) {
+	SetFlag (f_Heard, false);
+	_lastheard = now;
+    }
+    auto deadline = _lastheard + _deadtimeout;
+    if (now >= deadline) {
+	DEBUG_PRINTF ("[XE] %hu.Extern: no response from the peer in %u ms, disconnecting\n", MsgerId(), _deadtimeout);
+	Disconnect();
+	return PTimer::TimerNone;
+    }
+    auto nextping = max (_lastheard, _lastping) + _pinginterval;
+    if (now >= nextping) {	// written by the caller, even when corked
+	Enqueue (PCOM::PingMsg (extid_COM, false));
+	SetFlag (f_Flushing);
+	_lastping = now;
+	nextping = now + _pinginterval;
+    }
+    return min (nextping, deadline) - now;
 }
 
 //{{{2 WriteOutgoing ---------------------------------------------------
 
-// Writes queued messages. Returns true if need to wait for write.
-bool Extern::WriteOutgoing (void) noexcept
+// Collects iovecs for one write of queued messages, up to maxnm messages.
+// Fds still to be passed by the included messages are collected into
+// fds, in message order, up to c_MaxPassedFds. The last message may be
+// included partially, if it does not fit into c_MaxIOVecs. A stream
+// message is the last, since its spliced data follows it. Returns the
+// number of iovecs, and the number of messages included in nm.
+//
+unsigned Extern::CollectOutgoing (iovec* iov, unsigned maxnm, unsigned& nm, bool stage, fd_t* fds, unsigned& nfds) noexcept
 {
-    // Write all queued messages
-    while (!_outq.empty()) {
-	// Build sendmsg header
-	msghdr mh = {};
+    if (stage) {
+	_wbuf.reserve (c_StagingSize);
+	_wbuf.clear();
+    }
+    auto niov = 0u;
+    nfds = 0;
+    for (nm = 0; nm < maxnm && niov+2 <= c_MaxIOVecs;) {
+	auto mfds = _outq[nm].UnsentFdCount();
+	if (nfds+mfds > c_MaxPassedFds)
+	    break;
+	for (auto i = 0u; i < mfds; ++i)
+	    fds[nfds++] = _outq[nm].PassedFd(i);
+	auto& m = _outq[nm++];
+	auto first = niov, space = c_MaxIOVecs-niov;
+	niov += m.WriteIOVecs (&iov[niov], nm > 1 ? 0 : _bwritten, space);
+	if (stage)
+	    niov = StageIOVecs (iov, first, niov);
+	if (m.IOVecCount() > space || PCOM::IsStreamMethod (m.Method()))
+	    break;
+    }
+    return niov;
+}
 
-	// Add fd if being passed
-	char fdbuf [CMSG_SPACE(sizeof(int))] = {};
-	auto passedfd = _outq.front().PassedFd();
-	unsigned nm = (passedfd >= 0);
-	if (nm && !_bwritten) {	// only the first write passes the fd
-	    mh.msg_control = fdbuf;
-	    mh.msg_controllen = sizeof(fdbuf);
-	    auto cmsg = CMSG_FIRSTHDR(&mh);
-	    cmsg->cmsg_len = sizeof(fdbuf);
-	    cmsg->cmsg_level = SOL_SOCKET;
-	    cmsg->cmsg_type = SCM_RIGHTS;
-	    ostream fdos ((ostream::pointer) CMSG_DATA (cmsg), sizeof(passedfd));
-	    fdos << passedfd;
+// Closes fds passed by the first nm queued messages, marking them as sent
+void Extern::CloseSentFds (unsigned nm) noexcept
+{
+    for (auto m = 0u; m < nm; ++m) {
+	for (auto i = 0u, n = _outq[m].UnsentFdCount(); i < n; ++i) {
+	    close (_outq[m].PassedFd(i));
+	    _outq[m].SetPassedFd (i, -1);
 	}
+    }
+}
 
-	// See how many messages can be written at once, limited by fd passing.
-	// Can only pass one fd per sendmsg call, but can aggregate the rest.
-	while (nm < _outq.size() && !_outq[nm].HasFd())
-	    ++nm;
+// Copies small pieces in iov[first,last) into _wbuf, where adjacent ones
+// become a single piece. Empty pieces are removed. Returns the new last.
+unsigned Extern::StageIOVecs (iovec* iov, unsigned first, unsigned last) noexcept
+{
+    auto o = first;
+    for (auto i = first; i < last; ++i) {
+	auto v = iov[i];
+	if (!v.iov_len)
+	    continue;
+	if (v.iov_len <= c_MaxStagedSize && _wbuf.size()+v.iov_len <= _wbuf.capacity()) {
+	    auto p = _wbuf.end();
+	    _wbuf.resize (_wbuf.size()+v.iov_len);
+	    copy_n (static_cast<const char*>(v.iov_base), v.iov_len, p);
+	    if (p != _wbuf.begin() && static_cast<char*>(iov[o-1].iov_base)+iov[o-1].iov_len == p) {
+		iov[o-1].iov_len += v.iov_len;	// the previous piece is staged just before
+		continue;
+	    }
+	    v.iov_base = p;
+	}
+	iov[o++] = v;
+    }
+    return o;
+}
 
-	// Create iovecs for output
-	iovec iov [2*nm];	// two iovecs per message, header and body
+// Writes queued messages. Returns true if need to wait for write.
+bool Extern::WriteOutgoing (void) noexcept
+{
+    // Write all queued messages, and spliced data following them
+    for (;;) {
+	if (_spliceout.IsActive() && !WriteSplice())
+	    return _sockfd >= 0 && _spliceout.IsActive() && !_spliceout.IsBlocked();
+	if (_outq.empty())
+	    break;
+	if (_txring.IsOpen() && !_nsockmsgs)
+	    return WriteOutgoingRing();
+
+	// See how many messages can be written at once. The fds passed by
+	// all of them are sent together with the first written byte, and
+	// the kernel delivers them with the first read of it. When switching
+	// to the ring, only the messages queued before the switch are written.
+	// A packet socket takes one whole message per write.
+	auto maxnm = _txring.IsOpen() ? _nsockmsgs : _outq.size();
+	if (_einfo.isSeqPacket) {
+	    assert (_outq.front().Size() <= c_MaxPacketSize && _outq.front().IOVecCount() <= c_MaxIOVecs && "oversized messages must be refused by QueueOutgoing");
+	    maxnm = 1;
+	}
+	iovec iov [c_MaxIOVecs];
+	fd_t fds [c_MaxPassedFds];
+	unsigned nm, nfds;
+	msghdr mh = {};
 	mh.msg_iov = iov;
-	mh.msg_iovlen = 2*nm;
-	for (auto m = 0u, bw = _bwritten; m < nm; ++m, bw = 0)
-	    _outq[m].WriteIOVecs (&iov[2*m], bw);
+	mh.msg_iovlen = CollectOutgoing (iov, maxnm, nm, true, fds, nfds);
+
+	// Add fds if being passed
+	char fdbuf [CMSG_SPACE(c_MaxPassedFds*sizeof(fd_t))] = {};
+	if (nfds)
+	    SetPassedFdsCmsg (mh, fdbuf, fds, nfds);
 
 	// And try writing it all
 	if (auto smr = sendmsg (_sockfd, &mh, MSG_NOSIGNAL); smr <= 0) {
-	    if (!smr || errno == ECONNRESET)	// smr == 0 when remote end closes. No error then, just need to close this end too.
+	    if (!smr || errno == ECONNRESET || errno == EPIPE)	// smr == 0 when remote end closes. No error then, just need to close this end too.
 		DEBUG_PRINTF ("[X] %hu.Extern: wsocket %d closed by the other end\n", MsgerId(), _sockfd);
 	    else if (errno == EINTR)
 		continue;
-	    else if (errno == EAGAIN)
+	    else if (errno == EAGAIN) {
+		++_einfo.traffic.writeWaits;
 		return true;
-	    else
+	    } else
 		ErrorLibc ("sendmsg");
-	    Extern_Close();
+	    Disconnect();
 	    return false;
 	} else { // At this point sendmsg has succeeded and wrote some bytes
 	    DEBUG_PRINTF ("[X] Wrote %ld bytes to socket %d\n", smr, _sockfd);
 	    _bwritten += smr;
+	    _einfo.traffic.bytesOut += smr;
 	}
 
-	// Close the fd once successfully passed
-	if (passedfd >= 0)
-	    close (passedfd);
-
-	// Erase messages that have been fully written
-	auto ndone = 0u;
-	for (; ndone < nm && _bwritten >= _outq[ndone].Size(); ++ndone)
-	    _bwritten -= _outq[ndone].Size();
-	_outq.erase (_outq.begin(), ndone);
+	// Close the fds once successfully passed, marking them as sent
+	if (nfds)
+	    CloseSentFds (nm);
+
+	// Spliced data is written after its stream message
+	auto streamed = PCOM::IsStreamMethod (_outq[nm-1].Method());
+	auto ndone = EraseWritten (nm);
+	if (streamed && ndone == nm) {
+	    _spliceout.SetFd (_splicesrc[0].fd);
+	    _spliceout.Start (_splicesrc[0].size);
+	    _splicesrc.erase (_splicesrc.begin());
+	}
+	if (_txring.IsOpen()) {
+	    _nsockmsgs -= ndone;
+	    // Once switched to the ring, the deferred wakeup can be sent
+	    if (!_nsockmsgs && Flag (f_WakeupPending)) {
+		SetFlag (f_WakeupPending, false);
+		SendWakeup();
+	    }
+	}
 
 	assert (((_outq.empty() && !_bwritten) || (_bwritten < _outq.front().Size()))
 		&& "_bwritten must now be equal to bytes written from first message in queue");
     }
-    return false;
+    return false;
+}
+
+// Writes spliced data to the socket, closing its source when done.
+// Returns false if it must wait, or the connection was closed.
+bool Extern::WriteSplice (void) noexcept
+{
+    auto left = _spliceout.Left();
+    auto r = _spliceout.Transfer (_spliceout.Fd(), _sockfd);
+    _einfo.traffic.bytesOut += left - _spliceout.Left();
+    if (r == SpliceStream::Status::Ended) {
+	Error ("spliced data ended before its size");
+	Extern_Close();
+	return false;
+    } else if (r == SpliceStream::Status::Failed)
+	return SpliceFailed();
+    else if (r == SpliceStream::Status::WaitSocket)
+	++_einfo.traffic.writeWaits;
+    if (_spliceout.IsActive())
+	return false;
+    _spliceout.Finish();
+    close (_spliceout.SetFd (-1));
+    return true;
+}
+
+// The rest of the stream can not be sent or received, so the connection
+// is lost. The spliced fd may also be the one closed by the other end.
+// Returns false.
+bool Extern::SpliceFailed (void) noexcept
+{
+    if (errno != ECONNRESET && errno != EPIPE)
+	ErrorLibc ("splice");
+    else
+	DEBUG_PRINTF ("[X] %hu.Extern: spliced fd closed by the other end\n", MsgerId());
+    Disconnect();
+    return false;
+}
+
+// Writes queued messages to the shared memory ring.
+// Returns true if need to wait for socket write to pass an fd.
+bool Extern::WriteOutgoingRing (void) noexcept
+{
+    while (!_outq.empty()) {
+	// Aggregate messages as for sendmsg. Staging is not needed,
+	// since the ring write is already a copy.
+	iovec iov [c_MaxIOVecs];
+	fd_t fds [c_MaxPassedFds];
+	unsigned nm, nfds;
+	auto niov = CollectOutgoing (iov, _outq.size(), nm, false, fds, nfds);
+
+	// Passed fds are sent on the socket first, and marked as sent
+	if (nfds) {
+	    if (!SendWakeup (fds, nfds))
+		return _sockfd >= 0;
+	    CloseSentFds (nm);
+	}
+
+	auto bw = _txring.Write (iov, niov);
+	if (bw < 0) {
+	    Error ("shared memory ring corrupted");
+	    Extern_Close();
+	    return false;
+	} else if (!bw) {	// the ring is full, wait for the reader
+	    ++_einfo.traffic.writeWaits;
+	    if (_txring.WaitForReader())
+		return false;
+	    continue;
+	}
+	_bwritten += bw;
+	_einfo.traffic.bytesOut += bw;
+	if (_txring.ReaderWaiting() && !SendWakeup() && _sockfd < 0)
+	    return false;
+	EraseWritten (nm);
+    }
+    return false;
+}
+
+// Erases the messages fully written, of the first nm in the queue,
+// counting them in traffic statistics. Returns the number erased.
+unsigned Extern::EraseWritten (unsigned nm) noexcept
+{
+    auto& t = _einfo.traffic;
+    auto now = NowUs();
+    auto ndone = 0u;
+    for (; ndone < nm && _bwritten >= _outq[ndone].Size(); ++ndone) {
+	_bwritten -= _outq[ndone].Size();
+	auto qt = now - min (now, _outq[ndone].QueuedAt());
+	t.queueTime += qt;
+	t.maxQueueTime = max (t.maxQueueTime, qt);
+    }
+    _outq.pop_front (ndone);
+    t.msgsOut += ndone;
+    ++t.writes;
+    t.partialWrites += !!_bwritten;
+    return ndone;
 }
 
 //}}}2------------------------------------------------------------------
 //{{{2 ReadIncoming
 
+// Copies up to n bytes from p into iovecs, returning the number copied
+static streamsize CopyToIOVecs (const char* p, streamsize n, const iovec* iov, unsigned niov) noexcept
+{
+    streamsize nc = 0;
+    for (auto i = 0u; i < niov && nc < n; ++i) {
+	auto ic = min (n-nc, streamsize(iov[i].iov_len));
+	copy_n (p+nc, ic, static_cast<char*>(iov[i].iov_base));
+	nc += ic;
+    }
+    return nc;
+}
+
 void Extern::ReadIncoming (void) noexcept
 {
-    for (;;) {	// Read until EAGAIN
+    if (_einfo.isSeqPacket)
+	return ReadIncomingPackets();
+    if (_rxring.IsOpen() && !ReadWakeups())
+	return;
+    for (;;) {	// Read until EAGAIN, or until the ring is empty
+	// Spliced data precedes the next message
+	if (_splicein.IsActive() && !ReadSplice())
+	    return;
+
 	// Create iovecs for input
 	// There are three of them, representing the header and the body
 	// of each message, plus the fixed header of the next. The common
@@ -553,67 +1838,95 @@ void Extern::ReadIncoming (void) noexcept
 	// next message in each recvmsg call.
 	ExtMsg::Header fh = {};
 	iovec iov[3] = {{},{},{&fh,sizeof(fh)}};
-	_inmsg.WriteIOVecs (iov, _bread);
-
-	// Ancillary space for fd and credentials
-	char cmsgbuf [CMSG_SPACE(sizeof(_infd)) + CMSG_SPACE(sizeof(ucred))] = {};
+	_inmsg.ReadIOVecs (iov, _bread);
 
-	// Build struct for recvmsg
-	msghdr mh = {};
-	mh.msg_iov = iov;
-	mh.msg_iovlen = 2 + (_bread >= sizeof(fh));	// read another header only when already have one
-	mh.msg_control = cmsgbuf;
-	mh.msg_controllen = sizeof(cmsgbuf);
+	// Until the fixed header is complete, the body size in it is not
+	// valid, so only the rest of the fixed header is read.
+	unsigned niov = _bread < sizeof(fh) ? 1 : 3;
 
-	// Receive some data
-	if (auto rmr = recvmsg (_sockfd, &mh, 0); rmr <= 0) {
-	    if (!rmr || errno == ECONNRESET)	// br == 0 when remote end closes. No error then, just need to close this end too.
-		DEBUG_PRINTF ("[X] %hu.Extern: rsocket %d closed by the other end\n", MsgerId(), _sockfd);
-	    else if (errno == EINTR)
+	if (_rxring.IsOpen()) {
+	    auto rmr = _rxring.Read (iov, niov);
+	    if (rmr < 0) {
+		Error ("shared memory ring corrupted");
+		return Extern_Close();
+	    } else if (!rmr) {
+		if (_rxring.WaitForWriter())
+		    break;		// <--- the usual exit point in ring mode
 		continue;
-	    else if (errno == EAGAIN)
-		return;			// <--- the usual exit point
-	    else
-		ErrorLibc ("recvmsg");
-	    return Extern_Close();
-	} else {
-	    DEBUG_PRINTF ("[X] %hu.Extern: read %ld bytes from socket %d\n", MsgerId(), rmr, _sockfd);
+	    }
 	    _bread += rmr;
-	}
+	    _einfo.traffic.bytesIn += rmr;
+	} else if (_rbufp < _rbuf.size()) {	// parse data already received
+	    auto rmr = CopyToIOVecs (_rbuf.iat(_rbufp), _rbuf.size()-_rbufp, iov, niov);
+	    _rbufp += rmr;
+	    _bread += rmr;
+	} else {
+	    // Small messages are received in bulk into _rbuf, and large
+	    // bodies directly into _inmsg. Passed fds are queued in _infds
+	    // as received, and taken by messages in the order sent.
+	    auto direct = _bread >= sizeof(fh) && _inmsg.Size()-_bread >= c_RecvBufSize;
+	    if (!direct) {
+		_rbuf.reserve (c_RecvBufSize);
+		_rbuf.clear();
+		_rbufp = 0;
+		iov[0] = { _rbuf.data(), size_t(_rbuf.capacity()) };
+		niov = 1;
+	    }
 
-	// Check if ancillary data was passed
-	for (auto cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
-	    if (cmsg->cmsg_type == SCM_CREDENTIALS) {
-		istream is ((istream::pointer) CMSG_DATA(cmsg), sizeof(ucred));
-		is >> _einfo.creds;
-		EnableCredentialsPassing (false);	// Credentials only need to be received once
-		DEBUG_PRINTF ("[X] Received credentials: pid=%u,uid=%u,gid=%u\n", _einfo.creds.pid, _einfo.creds.uid, _einfo.creds.gid);
-	    } else if (cmsg->cmsg_type == SCM_RIGHTS) {
-		if (_infd >= 0) {	// if message is sent in multiple parts, the fd must only be sent with the first piece
-		    Error ("multiple file descriptors received in one message");
-		    return Extern_Close();
-		}
-		istream is ((istream::pointer) CMSG_DATA(cmsg), sizeof(_infd));
-		is >> _infd;
-		DEBUG_PRINTF ("[X] Received fd %d\n", _infd);
+	    // Ancillary space for fds and credentials
+	    char cmsgbuf [CMSG_SPACE(c_MaxPassedFds*sizeof(fd_t)) + CMSG_SPACE(sizeof(ucred))] = {};
+
+	    // Build struct for recvmsg
+	    msghdr mh = {};
+	    mh.msg_iov = iov;
+	    mh.msg_iovlen = niov;
+	    mh.msg_control = cmsgbuf;
+	    mh.msg_controllen = sizeof(cmsgbuf);
+
+	    // Receive some data
+	    if (auto rmr = recvmsg (_sockfd, &mh, 0); rmr <= 0) {
+		if (!rmr || errno == ECONNRESET)	// br == 0 when remote end closes. No error then, just need to close this end too.
+		    DEBUG_PRINTF ("[X] %hu.Extern: rsocket %d closed by the other end\n", MsgerId(), _sockfd);
+		else if (errno == EINTR)
+		    continue;
+		else if (errno == EAGAIN)
+		    return;			// <--- the usual exit point
+		else
+		    ErrorLibc ("recvmsg");
+		return Disconnect();
+	    } else {
+		DEBUG_PRINTF ("[X] %hu.Extern: read %ld bytes from socket %d\n", MsgerId(), rmr, _sockfd);
+		_einfo.traffic.bytesIn += rmr;
+		if (direct)
+		    _bread += rmr;
+		else
+		    _rbuf.resize (rmr);
 	    }
+
+	    // Check if ancillary data was passed
+	    if (!ReceiveAncillary (mh))
+		return;
+	    if (!direct)
+		continue;	// parse the buffer
 	}
 
 	// If the read message is complete, validate it and queue for delivery
 	if (_bread >= _inmsg.Size()) {
 	    _bread -= _inmsg.Size();
-	    _inmsg.DebugDump();
-
-	    // Write the passed fd into the body
-	    if (_inmsg.HasFd()) {
-		assert (_infd >= 0 && "_infd magically disappeared since header check");
-		_inmsg.SetPassedFd (_infd);
-		_infd = -1;
-	    }
-
-	    if (!AcceptIncomingMessage()) {
-		Error ("invalid message");
-		return Extern_Close();
+	    auto wasring = _rxring.IsOpen();
+	    if (!DeliverIncoming())
+		return;
+	    if (wasring != _rxring.IsOpen()) {
+		// Switched to the ring; further socket data is only wakeups
+		_bread = 0;
+		fh = {};
+		_rbufp = _rbuf.size();
+	    } else if (_splicein.IsActive()) {
+		// Spliced data follows, and was read as the next header.
+		// Stream messages are small, so it was read into _rbuf.
+		_rbufp -= _bread;
+		_bread = 0;
+		fh = {};
 	    }
 
 	    // Copy the fixed header of the next message
@@ -625,22 +1938,240 @@ void Extern::ReadIncoming (void) noexcept
 
 	// Now can check if fixed header is valid
 	if (_bread == sizeof(fh)) {
-	    auto& h = _inmsg.GetHeader();
-	    if (h.hsz < ExtMsg::c_MinHeaderSize
-		    || !IsAligned (h.hsz, Msg::Alignment::Header)
-		    || h.sz > ExtMsg::c_MaxBodySize
-		    || !IsAligned (h.sz, Msg::Alignment::Body)
-		    || (h.fdoffset != Msg::NoFdIncluded
-			&& (_infd < 0	// the fd must be passed at this point
-			    || h.fdoffset+sizeof(_infd) > h.sz
-			    || !IsAligned (h.fdoffset, Msg::Alignment::Fd)))
-		    || h.extid > extid_ServerLast) {
+	    if (!ValidIncomingHeader()) {
 		Error ("invalid message");
 		return Extern_Close();
 	    }
-	    _inmsg.ResizeBody (h.sz);
+	    _inmsg.AllocateBody();
+	}
+    }
+    // Reading frees space in the ring. Wakeups can only be written to
+    // the socket after the switch to the ring, since until then the
+    // other side reads messages from it.
+    if (_rxring.WriterWaiting()) {
+	if (_txring.IsOpen() && !_nsockmsgs)
+	    SendWakeup();
+	else
+	    SetFlag (f_WakeupPending);
+    }
+}
+
+// Writes received spliced data to the SpliceTo fd, first the part
+// already in _rbuf, then from the socket. Returns true when all of it
+// is written, false if it must wait, or the connection was closed.
+bool Extern::ReadSplice (void) noexcept
+{
+    SetFlag (f_Heard);	// for keepalive, since no messages arrive meanwhile
+    auto r = SpliceStream::Status::Done;
+    if (_rbufp < _rbuf.size()) {
+	streamsize nw;
+	r = _splicein.Write (_rbuf.iat(_rbufp), _rbuf.size()-_rbufp, nw);
+	_rbufp += nw;
+    }
+    if (r == SpliceStream::Status::Done && _splicein.IsActive()) {
+	auto left = _splicein.Left();
+	r = _splicein.Transfer (_sockfd, _splicein.Fd());
+	_einfo.traffic.bytesIn += left - _splicein.Left();
+    }
+    if (r == SpliceStream::Status::Ended) {
+	DEBUG_PRINTF ("[X] %hu.Extern: rsocket %d closed by the other end\n", MsgerId(), _sockfd);
+	Disconnect();
+	return false;
+    } else if (r == SpliceStream::Status::Failed)
+	return SpliceFailed();
+    if (_splicein.IsActive())
+	return false;
+    _splicein.Finish();
+    return true;
+}
+
+// On a packet socket, each message arrives whole in one packet, with
+// its fds, so there is no partially read message to keep track of.
+void Extern::ReadIncomingPackets (void) noexcept
+{
+    _rbuf.reserve (c_MaxPacketSize);
+    for (;;) {
+	iovec iov = { _rbuf.data(), size_t(_rbuf.capacity()) };
+	char cmsgbuf [CMSG_SPACE(c_MaxPassedFds*sizeof(fd_t)) + CMSG_SPACE(sizeof(ucred))] = {};
+	msghdr mh = {};
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cmsgbuf;
+	mh.msg_controllen = sizeof(cmsgbuf);
+
+	auto rmr = recvmsg (_sockfd, &mh, 0);
+	if (rmr <= 0) {
+	    if (!rmr || errno == ECONNRESET)
+		DEBUG_PRINTF ("[X] %hu.Extern: rsocket %d closed by the other end\n", MsgerId(), _sockfd);
+	    else if (errno == EINTR)
+		continue;
+	    else if (errno == EAGAIN)
+		return;			// <--- the usual exit point
+	    else
+		ErrorLibc ("recvmsg");
+	    return Disconnect();
+	}
+	DEBUG_PRINTF ("[X] %hu.Extern: read %ld byte packet from socket %d\n", MsgerId(), rmr, _sockfd);
+	_rbuf.resize (rmr);
+	_einfo.traffic.bytesIn += rmr;
+	if (!ReceiveAncillary (mh))
+	    return;
+
+	// The packet must contain exactly one message
+	ExtMsg::Header fh;
+	if (rmr < streamsize(sizeof(fh)) || (mh.msg_flags & (MSG_TRUNC| MSG_CTRUNC))) {
+	    Error ("invalid message");
+	    return Extern_Close();
+	}
+	copy_n (_rbuf.begin(), sizeof(fh), reinterpret_cast<char*>(&fh));
+	_inmsg.SetHeader (fh);
+	if (!ValidIncomingHeader() || rmr != _inmsg.Size()) {
+	    Error ("invalid message");
+	    return Extern_Close();
+	}
+	_inmsg.AllocateBody();
+	iovec miov[2];
+	_inmsg.ReadIOVecs (miov, sizeof(fh));
+	CopyToIOVecs (_rbuf.iat(sizeof(fh)), rmr-sizeof(fh), miov, ArraySize(miov));
+	if (!DeliverIncoming())
+	    return;
+    }
+}
+
+bool Extern::ValidIncomingHeader (void) const noexcept
+{
+    auto& h = _inmsg.GetHeader();
+    return h.hsz >= ExtMsg::c_MinHeaderSize
+	&& IsAligned (h.hsz, Msg::Alignment::Header)
+	&& IsAligned (h.sz, Msg::Alignment::Body)
+	&& h.flags < BitMask (ExtMsg::hf_Last)
+	&& (!GetBit (h.flags, ExtMsg::hf_LowPriority) || !GetBit (h.flags, ExtMsg::hf_HighPriority))
+	&& (!GetBit (h.flags, ExtMsg::hf_Compressed)	// only if negotiated, and not with fds
+	    || (_einfo.isCompressed && h.fdoffset == Msg::NoFdIncluded))
+	&& (h.fdoffset == Msg::NoFdIncluded
+	    || (h.fdoffset+sizeof(fd_t) <= h.sz
+		&& IsAligned (h.fdoffset, Msg::Alignment::Fd)))
+	&& (!GetBit (h.flags, ExtMsg::hf_FdArray)	// the array count precedes the fds
+	    || (h.fdoffset != Msg::NoFdIncluded && h.fdoffset >= sizeof(uint32_t)))
+	&& h.extid <= extid_ServerLast;
+}
+
+// Decompresses the completely read _inmsg, writes passed fds into its
+// body, and accepts it. Returns false if the connection was closed.
+bool Extern::DeliverIncoming (void) noexcept
+{
+    _inmsg.DebugDump();
+    ++_einfo.traffic.msgsIn;
+
+    if (_inmsg.IsCompressed() && !_inmsg.Decompress()) {
+	Error ("invalid compressed message");
+	Extern_Close();
+	return false;
+    }
+    if (_capfd >= 0)
+	CaptureIncoming();
+
+    // Write the passed fds into the body. On the socket, fds arrive
+    // with the first byte of the write that included the message.
+    // In ring mode, they are sent on the socket before the message.
+    if (auto nfds = _inmsg.FdCount(); _inmsg.HasFd()) {
+	if (!nfds || nfds > c_MaxPassedFds || _inmsg.FdOffset()+nfds*sizeof(fd_t) > _inmsg.BodySize()) {
+	    Error ("invalid message");
+	    Extern_Close();
+	    return false;
+	}
+	if (_infds.size() < nfds && _rxring.IsOpen() && !ReadWakeups (nfds))
+	    return false;
+	if (_infds.size() < nfds) {
+	    Error ("invalid message");
+	    Extern_Close();
+	    return false;
+	}
+	for (auto i = 0u; i < nfds; ++i)
+	    _inmsg.SetPassedFd (i, _infds[i]);
+	_infds.erase (_infds.begin(), nfds);
+    }
+
+    if (!AcceptIncomingMessage()) {
+	Error ("invalid message");
+	Extern_Close();
+	return false;
+    }
+    return true;
+}
+
+// Writes the decompressed _inmsg to the capture file, before passed
+// fds are written into its body. The write is synchronous; captures
+// are for testing, and the file is expected to keep up.
+void Extern::CaptureIncoming (void) noexcept
+{
+    auto now = NowUs();
+    auto& h = _inmsg.GetHeader();
+    PExtern::CaptureRecord r = { uint32_t (min (now-_lastcap, uint64_t(UINT32_MAX))), uint32_t(_inmsg.Size()) };
+    _lastcap = now;
+    auto& hstr = _inmsg.HeaderStrings();
+    auto body = _inmsg.Read();
+    iovec iov[] = {
+	{ &r, sizeof(r) },
+	{ const_cast<ExtMsg::Header*>(&h), sizeof(h) },
+	{ const_cast<char*>(hstr.data()), size_t(hstr.size()) },
+	{ const_cast<char*>(body.ptr<char>()), size_t(body.remaining()) }
+    };
+    for (auto i = 0u; i < ArraySize(iov);) {
+	auto bw = writev (_capfd, &iov[i], ArraySize(iov)-i);
+	if (bw < 0 && errno == EINTR)
+	    continue;
+	if (bw <= 0) {
+	    DEBUG_PRINTF ("[XE] %hu.Extern: capture stopped: %s\n", MsgerId(), strerror(errno));
+	    close (exchange (_capfd, -1));
+	    return;
 	}
+	for (; i < ArraySize(iov) && size_t(bw) >= iov[i].iov_len; ++i)
+	    bw -= iov[i].iov_len;
+	if (i < ArraySize(iov)) {
+	    iov[i].iov_base = static_cast<char*>(iov[i].iov_base)+bw;
+	    iov[i].iov_len -= bw;
+	}
+    }
+}
+
+// Processes ancillary data received with socket data.
+// Returns false if the connection was closed on error.
+bool Extern::ReceiveAncillary (msghdr& mh) noexcept
+{
+    for (auto cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+	if (cmsg->cmsg_type == SCM_CREDENTIALS) {
+	    istream is ((istream::pointer) CMSG_DATA(cmsg), sizeof(ucred));
+	    is >> _einfo.creds;
+	    EnableCredentialsPassing (false);	// Credentials only need to be received once
+	    DEBUG_PRINTF ("[X] Received credentials: pid=%u,uid=%u,gid=%u\n", _einfo.creds.pid, _einfo.creds.uid, _einfo.creds.gid);
+	} else if (cmsg->cmsg_type == SCM_RIGHTS) {
+	    auto nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(fd_t);
+	    istream is ((istream::pointer) CMSG_DATA(cmsg), nfds*sizeof(fd_t));
+	    for (auto i = 0u; i < nfds; ++i)
+		_infds.push_back (is.readv<fd_t>());
+	    DEBUG_PRINTF ("[X] Received %zu fds, %u queued\n", nfds, _infds.size());
+	}
+    }
+    // Fds can only be queued for messages not yet read, and more than
+    // that means the other side is not using them.
+    if (_infds.size() > 2*c_MaxPassedFds || (mh.msg_flags & MSG_CTRUNC)) {
+	Error ("too many file descriptors received");
+	Extern_Close();
+	return false;
     }
+    return true;
+}
+
+// Spliced data follows on the socket, to be written to the SpliceTo fd
+bool Extern::AcceptStream (void) noexcept
+{
+    if (_inmsg.Extid() != extid_COM || _rxring.IsOpen() || _einfo.isSeqPacket || _splicein.Fd() < 0) {
+	DEBUG_PRINTF ("[XE] Incoming spliced data has no destination\n");
+	return false;
+    }
+    _splicein.Start (_inmsg.Read().readv<uint64_t>());
+    return true;
 }
 
 bool Extern::AcceptIncomingMessage (void) noexcept
@@ -651,19 +2182,44 @@ bool Extern::AcceptIncomingMessage (void) noexcept
 	DEBUG_PRINTF ("[XE] Incoming message has invalid header strings\n");
 	return false;
     }
+    // Validation is strict, since strings from another process may
+    // contain embedded zeroes intended to be truncated on use.
     auto msgis = _inmsg.Read();
-    auto vsz = Msg::ValidateSignature (msgis, SignatureOfMethod(method));
+    auto vsz = Msg::ValidateSignature (msgis, SignatureOfMethod(method), true);
     if (Align (vsz, Msg::Alignment::Body) != _inmsg.BodySize()) {
 	DEBUG_PRINTF ("[XE] Incoming message body failed validation\n");
 	return false;
     }
     _inmsg.TrimBody (vsz);	// Local messages store unpadded size
+    SetFlag (f_Heard);	// for keepalive
+
+    if (PCOM::IsRingMethod (method))
+	return AttachRing();
+    if (PCOM::IsStreamMethod (method))
+	return AcceptStream();
+    if (PCOM::IsPingMethod (method)) {
+	if (!_inmsg.Read().readv<bool>()) {	// written after reading, even when corked
+	    Enqueue (PCOM::PingMsg (extid_COM, true));
+	    SetFlag (f_Flushing);
+	}
+	return true;
+    }
 
     // Lookup or create local relay proxy
+    auto iid = InterfaceOfMethod (method);
     auto rp = RelayProxyByExtid (_inmsg.Extid());
-    if (!rp) {
+    if (rp) {
+	// Relays created by the peer only accept the interface granted
+	if (rp->iid && iid != rp->iid && iid != PCOM::Interface()) {
+	    DEBUG_PRINTF ("[XE] Incoming message changes the relay interface\n");
+	    return false;
+	}
+    } else {
+	// The relay may have been deleted while this was in flight
+	if (PCOM::IsDeleteMethod (method))
+	    return true;
 	// Verify that the requested interface is on the exported list
-	if (!_einfo.IsExporting (InterfaceOfMethod (method))) {
+	if (!_einfo.IsExporting (iid)) {
 	    DEBUG_PRINTF ("[XE] Incoming message requests unexported interface\n");
 	    return false;
 	}
@@ -672,16 +2228,28 @@ bool Extern::AcceptIncomingMessage (void) noexcept
 	    DEBUG_PRINTF ("[XE] Extern connection peer allocates incorrect extids\n");
 	    return false;
 	}
+	// Peers denied access are told the object is deleted. A relay
+	// is not created, so each message sent before that is denied.
+	if (!IsAccessible (iid)) {
+	    DEBUG_PRINTF ("[X] Access to %s denied to uid %u\n", iid, _einfo.creds.uid);
+	    Enqueue (PCOM::DeleteMsg (_inmsg.Extid()));	// written after reading
+	    SetFlag (f_Flushing);
+	    return true;
+	}
 	DEBUG_PRINTF ("[X] Creating new extid link %hu\n", _inmsg.Extid());
-	rp = &_relays.emplace_back (MsgerId(), mrid_New, _inmsg.Extid());
+	rp = &_relays.emplace_back (MsgerId(), mrid_New, _inmsg.Extid(), iid);
 	//
 	// Create a COMRelay as the destination. It will then create the
 	// actual server Msger using the interface in the message.
 	rp->relay.CreateDestAs (PCOM::Interface());
+	IndexRelay (_relays.size()-1);
     }
 
     // Create local message from ExtMsg and forward it to the COMRelay
-    rp->relay.Forward (Msg (rp->relay.Link(), method, _inmsg.MoveBody(), _inmsg.Extid(), _inmsg.FdOffset()));
+    Msg msg (rp->relay.Link(), method, _inmsg.MoveBody(), _inmsg.Extid(), _inmsg.FdOffset(), _inmsg.FdCount());
+    msg.SetRequestId (_inmsg.RequestId());
+    msg.SetPriority (_inmsg.GetPriority());
+    rp->relay.Forward (move(msg));
     return true;
 }
 //}}}2
@@ -702,9 +2270,13 @@ COMRelay::COMRelay (const Msg::Link& l) noexcept
 //
 ,_localp (l.dest, _pExtern ? mrid_t(mrid_New) : l.src)
 //
-// Extid will be determined when the connection interface is known
+// Interface and extid will be determined with the first message
+,_iface()
 ,_extid()
 {
+    // Outgoing messages are queued in the Extern as they are, so
+    // scatter/gather bodies can be written without gathering them.
+    SetFlag (f_ScatterGather);
 }
 
 COMRelay::~COMRelay (void) noexcept
@@ -716,12 +2288,14 @@ COMRelay::~COMRelay (void) noexcept
     //    COMRelay_COM_Delete and the extern pointer is reset to prevent
     //    further messages to remote object. Here, no message is sent.
     // 3. The Extern object is destroyed. pExtern is reset in
-    //    COMRelay_ObjectDestroyed, and no message is sent here.
+    //    OnMsgerDestroyed or OnExternDestroyed, and no message is sent
+    //    here, unless the relay has failed over to another Extern.
     if (_pExtern) {
 	if (_extid)
 	    _pExtern->QueueOutgoing (PCOM::DeleteMsg (_extid));
 	_pExtern->UnregisterRelay (this);
-    }
+    } else if (auto e = Extern::LookupByRelayId (MsgerId()); e)
+	e->UnregisterRelay (this);	// after COM_Delete, still registered
     _pExtern = nullptr;
     _extid = 0;
 }
@@ -732,11 +2306,16 @@ bool COMRelay::Dispatch (Msg& msg) noexcept
     if (PCOM::Dispatch (this, msg))
 	return true;
 
+    // Broadcasts, like Signal, are for local objects, and not forwarded
+    if (msg.Dest() == mrid_Broadcast)
+	return Msger::Dispatch (msg);
+
     // Messages to imported interfaces need to be routed to the Extern
     // that imports it. The interface was unavailable in ctor, so here.
     if (!_pExtern) {	// If null here, then this relay was created by a local Msger
 	auto iface = msg.Interface();
-	if (!(_pExtern = Extern::LookupByImported (iface))) {
+	_iface = iface;	// saved for failover
+	if (!(_pExtern = Extern::LookupByImported (iface, _localp.Dest()))) {
 	    Error ("interface %s has not been imported", iface);
 	    return false;	// the caller should have waited for Extern Connected reply before creating this
 	}
@@ -794,6 +2373,33 @@ void COMRelay::OnMsgerDestroyed (mrid_t id) noexcept
     SetFlag (f_Unused);
 }
 
+// Called by the Extern being destroyed. Returns true on failover.
+bool COMRelay::OnExternDestroyed (void) noexcept
+{
+    _pExtern = nullptr;
+    _extid = 0;
+    if (Failover())
+	return true;
+    SetFlag (f_Unused);
+    return false;
+}
+
+// Moves the relay to another Extern importing its interface, if the
+// interface has a balancing policy. The remote object is created anew
+// there, so this is only useful for stateless remote objects.
+bool COMRelay::Failover (void) noexcept
+{
+    if (!_iface || !Extern::CanFailover (_iface))
+	return false;
+    auto e = Extern::LookupByImported (_iface, _localp.Dest());
+    if (!e)
+	return false;
+    DEBUG_PRINTF ("[X] COMRelay %hu failing over to extern %hu\n", MsgerId(), e->MsgerId());
+    _pExtern = e;
+    _extid = _pExtern->RegisterRelay (this);
+    return true;
+}
+
 void COMRelay::COM_Error (const lstring& errmsg) noexcept
 {
     // COM_Error is received for errors in the remote object. The remote
@@ -831,11 +2437,16 @@ PExternServer::~PExternServer (void) noexcept
 }
 
 /// Create server socket bound to the given address
-auto PExternServer::Bind (const sockaddr* addr, socklen_t addrlen, const iid_t* eifaces) noexcept -> fd_t
+auto PExternServer::Bind (const sockaddr* addr, socklen_t addrlen, const iid_t* eifaces, ReusePort reuse, int socktype) noexcept -> fd_t
 {
-    auto fd = socket (addr->sa_family, SOCK_STREAM| SOCK_NONBLOCK| SOCK_CLOEXEC, IPPROTO_IP);
+    auto fd = socket (addr->sa_family, socktype| SOCK_NONBLOCK| SOCK_CLOEXEC, IPPROTO_IP);
     if (fd < 0)
 	return fd;
+    if (int sov = 1; reuse == ReusePort::On && 0 > setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &sov, sizeof(sov))) {
+	DEBUG_PRINTF ("[E] Failed to set SO_REUSEPORT: %s\n", strerror(errno));
+	close (fd);
+	return -1;
+    }
     if (0 > bind (fd, addr, addrlen) && errno != EINPROGRESS) {
 	DEBUG_PRINTF ("[E] Failed to bind to socket: %s\n", strerror(errno));
 	close (fd);
@@ -853,7 +2464,7 @@ auto PExternServer::Bind (const sockaddr* addr, socklen_t addrlen, const iid_t*
 }
 
 /// Create local socket with given path
-auto PExternServer::BindLocal (const char* path, const iid_t* eifaces) noexcept -> fd_t
+auto PExternServer::BindLocal (const char* path, const iid_t* eifaces, int socktype) noexcept -> fd_t
 {
     sockaddr_un addr;
     addr.sun_family = PF_LOCAL;
@@ -862,7 +2473,7 @@ auto PExternServer::BindLocal (const char* path, const iid_t* eifaces) noexcept
 	return -1;
     }
     DEBUG_PRINTF ("[X] Creating server socket %s\n", addr.sun_path);
-    auto fd = Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces);
+    auto fd = Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces, ReusePort::Off, socktype);
     if (0 > chmod (addr.sun_path, DEFFILEMODE))
 	DEBUG_PRINTF ("[E] Failed to change socket permissions: %s\n", strerror(errno));
     return fd;
@@ -903,8 +2514,14 @@ auto PExternServer::BindUserLocal (const char* sockname, const iid_t* eifaces) n
     return fd;
 }
 
+/// Create the broker daemon socket
+auto PExternServer::BindBroker (const iid_t* eifaces) noexcept -> fd_t
+{
+    return BindUserLocal (PExternBroker::c_SocketName, eifaces);
+}
+
 /// Create local IPv4 socket at given ip and port
-auto PExternServer::BindIP4 (in_addr_t ip, in_port_t port, const iid_t* eifaces) noexcept -> fd_t
+auto PExternServer::BindIP4 (in_addr_t ip, in_port_t port, const iid_t* eifaces, ReusePort reuse) noexcept -> fd_t
 {
     sockaddr_in addr = {};
     addr.sin_family = PF_INET,
@@ -914,31 +2531,31 @@ auto PExternServer::BindIP4 (in_addr_t ip, in_port_t port, const iid_t* eifaces)
 	addr.sin_addr = { ip };
     #endif
     addr.sin_port = port;
-    return Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces);
+    return Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces, reuse);
 }
 
 /// Create local IPv4 socket at given port on the loopback interface
-auto PExternServer::BindLocalIP4 (in_port_t port, const iid_t* eifaces) noexcept -> fd_t
-    { return BindIP4 (INADDR_LOOPBACK, port, eifaces); }
+auto PExternServer::BindLocalIP4 (in_port_t port, const iid_t* eifaces, ReusePort reuse) noexcept -> fd_t
+    { return BindIP4 (htonl (INADDR_LOOPBACK), port, eifaces, reuse); }
 
 /// Create local IPv6 socket at given ip and port
-auto PExternServer::BindIP6 (in6_addr ip, in_port_t port, const iid_t* eifaces) noexcept -> fd_t
+auto PExternServer::BindIP6 (in6_addr ip, in_port_t port, const iid_t* eifaces, ReusePort reuse) noexcept -> fd_t
 {
     sockaddr_in6 addr = {};
     addr.sin6_family = PF_INET6;
     addr.sin6_addr = ip;
     addr.sin6_port = port;
-    return Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces);
+    return Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces, reuse);
 }
 
 /// Create local IPv6 socket at given ip and port
-auto PExternServer::BindLocalIP6 (in_port_t port, const iid_t* eifaces) noexcept -> fd_t
+auto PExternServer::BindLocalIP6 (in_port_t port, const iid_t* eifaces, ReusePort reuse) noexcept -> fd_t
 {
     sockaddr_in6 addr = {};
     addr.sin6_family = PF_INET6;
     addr.sin6_addr = IN6ADDR_LOOPBACK_INIT;
     addr.sin6_port = port;
-    return Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces);
+    return Bind (reinterpret_cast<const sockaddr*>(&addr), sizeof(addr), eifaces, reuse);
 }
 
 //}}}-------------------------------------------------------------------
@@ -981,12 +2598,14 @@ bool ExternServer::Dispatch (Msg& msg) noexcept
 
 void ExternServer::TimerR_Timer (PTimer::fd_t) noexcept
 {
-    for (int cfd; 0 <= (cfd = accept (_sockfd, nullptr, nullptr));) {
+    // Accepted sockets are created nonblocking, as Extern requires
+    auto n = 0u;
+    for (int cfd; n < c_MaxAcceptBatch && 0 <= (cfd = accept4 (_sockfd, nullptr, nullptr, SOCK_NONBLOCK| SOCK_CLOEXEC)); ++n) {
 	DEBUG_PRINTF ("[X] Client connection accepted on fd %d\n", cfd);
 	_conns.emplace_back (MsgerId()).Open (cfd, _eifaces);
 	SetFlag (f_Unused, false);
     }
-    if (errno == EAGAIN) {
+    if (n >= c_MaxAcceptBatch || errno == EAGAIN || errno == ECONNABORTED) {
 	DEBUG_PRINTF ("[X] Resuming wait on fd %d\n", _sockfd);
 	_timer.WaitRead (_sockfd);
     } else {
@@ -998,7 +2617,7 @@ void ExternServer::TimerR_Timer (PTimer::fd_t) noexcept
 void ExternServer::ExternServer_Open (int fd, const iid_t* eifaces, PExternServer::WhenEmpty closeWhenEmpty) noexcept
 {
     assert (_sockfd == -1 && "each ExternServer instance can only listen to one socket");
-    if (auto f = fcntl (fd, F_GETFL); f < 0 || 0 > fcntl (fd, F_SETFL, O_NONBLOCK| f))
+    if (auto f = fcntl (fd, F_GETFL); f < 0 || (!(f & O_NONBLOCK) && 0 > fcntl (fd, F_SETFL, O_NONBLOCK| f)))
 	return ErrorLibc ("fcntl(SETFL(O_NONBLOCK))");
     _sockfd = fd;
     _eifaces = eifaces;
@@ -1017,5 +2636,314 @@ void ExternServer::ExternR_Connected (const ExternInfo* einfo) noexcept
     _reply.Connected (einfo);
 }
 
+//}}}-------------------------------------------------------------------
+//{{{ ExternPool
+
+DEFINE_INTERFACE (ExternPool)
+DEFINE_INTERFACE (ExternPoolR)
+
+ExternPool::ExternPool (const Msg::Link& l) noexcept
+: Msger(l)
+,_warm()
+,_launched()
+,_reply (l)
+,_exe()
+,_arg()
+,_exepath()
+,_nwarm()
+,_nrestarts()
+{
+}
+
+ExternPool::~ExternPool (void) noexcept
+{
+    // Warm processes have not been used, and can be terminated.
+    // SIGCHLD is no longer handled here, so they are reaped directly.
+    for (auto& p : _warm) {
+	close (p.fd);
+	kill (p.pid, SIGTERM);
+    }
+    for (auto& p : _warm)
+	waitpid (p.pid, nullptr, 0);
+    // Launched processes are still serving their clients, and so
+    // can not be waited for. Those that have exited are reaped.
+    for (auto pid : _launched)
+	waitpid (pid, nullptr, WNOHANG);
+}
+
+bool ExternPool::Dispatch (Msg& msg) noexcept
+{
+    return PExternPool::Dispatch (this, msg)
+	|| PSignal::Dispatch (this, msg)
+	|| Msger::Dispatch (msg);
+}
+
+// Spawns warm processes until there are nwarm of them
+bool ExternPool::Replenish (uint32_t nwarm) noexcept
+{
+    while (_warm.size() < nwarm) {
+	Pipe p;
+	if (0 > (p.fd = SpawnPipe (_exepath.c_str(), _exe, _arg, p.pid))) {
+	    ErrorLibc ("posix_spawn");
+	    return false;
+	}
+	DEBUG_PRINTF ("[X] Spawned warm %s as pid %d\n", _exe, p.pid);
+	_warm.push_back (p);
+    }
+    return true;
+}
+
+void ExternPool::ExternPool_Open (const char* exe, const char* arg, uint32_t nwarm) noexcept
+{
+    assert (!_exe && "each ExternPool instance can only launch one executable");
+    char exepath [PATH_MAX];
+    auto exefp = executable_in_path (exe, ArrayBlock(exepath));
+    if (!exefp)
+	return Error ("executable %s not found", exe);
+    _exepath = exefp;
+    _exe = exe;
+    _arg = arg;
+    _nwarm = nwarm;
+    Replenish (_nwarm);
+}
+
+void ExternPool::ExternPool_Launch (void) noexcept
+{
+    assert (_exe && "ExternPool must be opened before Launch");
+    // Launches beyond the warm count are spawned here
+    if (_warm.empty() && !Replenish (1))
+	return;
+    auto p = _warm.front();
+    _warm.erase (_warm.begin());
+    _launched.push_back (p.pid);
+    _nrestarts = 0;
+    _reply.Launched (p.fd);
+    Replenish (_nwarm);
+}
+
+void ExternPool::Signal_Signal (int sig) noexcept
+{
+    if (sig != SIGCHLD)
+	return;
+    // Warm processes that exited are restarted. Another waitpid
+    // in the app may have reaped them first, returning ECHILD.
+    auto nexited = 0u;
+    for (auto i = _warm.size(); i--;) {
+	if (!waitpid (_warm[i].pid, nullptr, WNOHANG))
+	    continue;
+	DEBUG_PRINTF ("[X] Warm %s pid %d exited\n", _exe, _warm[i].pid);
+	close (_warm[i].fd);
+	_warm.erase (_warm.iat(i));
+	++nexited;
+    }
+    remove_if (_launched, [](pid_t pid) { return waitpid (pid, nullptr, WNOHANG) != 0; });
+    if (!nexited)
+	return;
+    if ((_nrestarts += nexited) > c_MaxRestarts)
+	return Error ("%s keeps exiting before launch", _exe);
+    Replenish (_nwarm);
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ PExternBroker
+
+DEFINE_INTERFACE (ExternBroker)
+DEFINE_INTERFACE (ExternBrokerR)
+
+void PExternBroker::Register (fd_t sfd, const iid_t* eifaces) noexcept
+{
+    auto elstr = PCOM::StringFromInterfaceList (eifaces);
+    auto& msg = CreateMsg (M_Register(), stream_size_of(sfd)+stream_size_of(elstr), 0);
+    auto os = msg.Write();
+    os << sfd << elstr;
+    CommitMsg (msg, os);
+}
+
+void PExternBrokerR::Connection (fd_t fd, const lstring& iname) noexcept
+{
+    auto& msg = CreateMsg (M_Connection(), stream_size_of(fd)+stream_size_of(iname), 0);
+    auto os = msg.Write();
+    os << fd << iname;
+    CommitMsg (msg, os);
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ ExternBroker
+
+ExternBroker::ExternBroker (const Msg::Link& l) noexcept
+: Msger(l)
+,_reply (l)
+,_relayed (MsgerId())
+,_registered()
+,_waiting()
+,_addrlen()
+,_socktype (SOCK_STREAM)
+,_addr()
+{
+    BrokerTable().push_back (this);
+}
+
+ExternBroker::~ExternBroker (void) noexcept
+{
+    Unpublish();
+    remove_if (BrokerTable(), [&](auto b) { return b == this; });
+}
+
+bool ExternBroker::Dispatch (Msg& msg) noexcept
+{
+    return PExternBroker::Dispatch (this, msg)
+	|| PExternR::Dispatch (this, msg)
+	|| Msger::Dispatch (msg);
+}
+
+void ExternBroker::OnMsgerDestroyed (mrid_t mid) noexcept
+{
+    Msger::OnMsgerDestroyed (mid);
+    if (mid == _relayed.Dest()) {	// the server has exited
+	Unpublish();
+	SetFlag (f_Unused);
+    }
+}
+
+auto ExternBroker::LookupService (const lstring& iname) noexcept -> Service* // static
+{
+    return linear_search_if (ServiceTable(), [&](const auto& s)
+		{ return s.iname == iname; });
+}
+
+void ExternBroker::ExternBroker_Register (fd_t sfd, const lstring& elist) noexcept
+{
+    // Connections are made to the address of the listening socket,
+    // with the same socket type.
+    _addrlen = sizeof(_addr);
+    auto r = getsockname (sfd, reinterpret_cast<sockaddr*>(&_addr), &_addrlen);
+    socklen_t tl = sizeof(_socktype);
+    if (r >= 0)
+	r = getsockopt (sfd, SOL_SOCKET, SO_TYPE, &_socktype, &tl);
+    close (sfd);
+    if (r < 0)
+	return ErrorLibc ("failed to get the server socket address");
+    auto relayed = false;
+    for (auto ei = elist.begin(); ei < elist.end();) {
+	auto eic = elist.find (',', ei);
+	if (!eic)
+	    eic = elist.end();
+	auto& i = _registered.emplace_back (ei, eic);
+	relayed |= !!App::InterfaceByName (i.c_str(), i.size()+1);
+	ei = eic+1;
+    }
+    // Interfaces known here are relayed through a connection to the
+    // server, and are available once it is connected.
+    if (!relayed)
+	Publish();
+    else if (0 > _relayed.Connect (reinterpret_cast<const sockaddr*>(&_addr), _addrlen, _socktype))
+	ErrorLibc ("connect");
+}
+
+void ExternBroker::ExternR_Connected (const ExternInfo*) noexcept
+{
+    Publish();
+}
+
+void ExternBroker::Publish (void) noexcept
+{
+    DEBUG_PRINTF ("[X] Broker %hu publishing %u interfaces\n", MsgerId(), _registered.size());
+    for (auto& i : _registered)
+	ServiceTable().push_back (Service { i, this });
+    for (auto b : BrokerTable())
+	remove_if (b->_waiting, [&](const auto& i) { return b->Handoff (i); });
+}
+
+void ExternBroker::Unpublish (void) noexcept
+{
+    remove_if (ServiceTable(), [&](const auto& s) { return s.server == this; });
+}
+
+void ExternBroker::ExternBroker_Connect (const lstring& iname) noexcept
+{
+    if (!Handoff (iname))
+	_waiting.emplace_back (iname);
+}
+
+// Connects to the server of iname for the caller. Returns false
+// if no server for it has been registered.
+bool ExternBroker::Handoff (const lstring& iname) noexcept
+{
+    auto s = LookupService (iname);
+    if (!s)
+	return false;
+    auto fd = PExtern::ConnectSocket (reinterpret_cast<const sockaddr*>(&s->server->_addr), s->server->_addrlen, s->server->_socktype);
+    if (fd < 0)
+	ErrorLibc ("connect");
+    else
+	_reply.Connection (fd, iname);
+    return true;
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ ExternStats
+
+DEFINE_INTERFACE (ExternStats)
+DEFINE_INTERFACE (ExternStatsR)
+
+bool ExternStats::Dispatch (Msg& msg) noexcept
+{
+    return PExternStats::Dispatch (this, msg)
+	|| Msger::Dispatch (msg);
+}
+
+void ExternStats::ExternStats_Query (void) noexcept
+{
+    PExternStatsR::connections_t conns;
+    Extern::ForEach ([&](const Extern& e) {
+	auto& einfo = e.Info();
+	conns.push_back ({ e.MsgerId(), uint16_t(e.RelayCount()), int32_t(einfo.creds.pid), einfo.traffic });
+    });
+    _reply.Stats (conns);
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ PTransfer
+
+DEFINE_INTERFACE (Transfer)
+
+void PTransfer::Data (const cmemlink& chunk) noexcept
+{
+    assert (chunk.size() <= c_ChunkSize && "use Write to split data into chunks");
+    assert (chunk.size() <= Window() && "wait for the receiver to acknowledge more data");
+    auto& msg = CreateMsg (M_Data(), sizeof(chunk.size()));
+    auto os = msg.Write();
+    os << chunk.size();
+    // The chunk is linked to avoid copying, so it must remain
+    // valid until acknowledged. The unaligned tail is copied,
+    // to pad the array to its stream alignment.
+    auto asz = Floor (chunk.size(), sizeof(chunk.size()));
+    msg.AppendSegment (Msg::Segment (chunk.data(), asz));
+    if (auto tailsz = chunk.size()-asz; tailsz) {
+	Msg::Segment tail (Align (tailsz, sizeof(chunk.size())));
+	fill (copy_n (chunk.iat(asz), tailsz, tail.begin()), tail.end(), 0);
+	msg.AppendSegment (move(tail));
+    }
+    _sent += chunk.size();
+    CommitMsg (msg, os);
+}
+
+streamsize PTransfer::Write (const cmemlink& data) noexcept
+{
+    // Send as many chunks of data as the window allows
+    streamsize bw = 0;
+    while (bw < data.size() && Window()) {
+	auto csz = min (data.size()-bw, min (Window(), streamsize(c_ChunkSize)));
+	Data (cmemlink (data.iat(bw), csz));
+	bw += csz;
+    }
+    return bw;
+}
+
+//}}}-------------------------------------------------------------------
+//{{{ PTransferR
+
+DEFINE_INTERFACE (TransferR)
+
 } // namespace cwiclo
 //}}}-------------------------------------------------------------------
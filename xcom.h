@@ -12,10 +12,13 @@
 namespace cwiclo {
 
 class PCOM : public Proxy {
-    DECLARE_INTERFACE (COM, (Error,"s")(Export,"s")(Delete,""))
+    DECLARE_INTERFACE (COM, (Error,"s")(Export,"s")(Delete,"")(Ring,"h")(Ping,"b")(Stream,"t"))
+public:
+    using fd_t = PTimer::fd_t;
 public:
 		PCOM (mrid_t src, mrid_t dest)	: Proxy (src, dest) {}
 		~PCOM (void) noexcept		{ FreeId(); }
+    void	Detach (void)			{ LinkW().dest = mrid_New; }
     void	Error (const string& errmsg)	{ Send (M_Error(), errmsg); }
     void	Export (const string& elist)	{ Send (M_Export(), elist); }
     void	Delete (void)			{ Send (M_Delete()); }
@@ -25,7 +28,14 @@ public:
     static Msg	ExportMsg (mrid_t extid, const string& elstr) noexcept;
     static Msg	ExportMsg (mrid_t extid, const iid_t* elist) noexcept
 							{ return ExportMsg (extid, StringFromInterfaceList (elist)); }
-    static Msg	DeleteMsg (mrid_t extid) noexcept	{ return Msg (Msg::Link{}, PCOM::M_Delete(), 0, extid); }
+    static Msg	DeleteMsg (mrid_t extid) noexcept;
+    static bool	IsDeleteMethod (methodid_t mid)	{ return mid == M_Delete(); }
+    static Msg	RingMsg (mrid_t extid, fd_t fd) noexcept;
+    static bool	IsRingMethod (methodid_t mid)	{ return mid == M_Ring(); }
+    static Msg	PingMsg (mrid_t extid, bool isreply) noexcept;
+    static bool	IsPingMethod (methodid_t mid)	{ return mid == M_Ping(); }
+    static Msg	StreamMsg (mrid_t extid, uint64_t size) noexcept;
+    static bool	IsStreamMethod (methodid_t mid)	{ return mid == M_Stream(); }
     template <typename O>
     inline static bool Dispatch (O* o, const Msg& msg) noexcept {
 	if (msg.Method() == M_Error())
@@ -44,25 +54,118 @@ public:
 //{{{ PExtern
 
 class PExtern : public Proxy {
-    DECLARE_INTERFACE (Extern, (Open,"xib")(Close,""))
+    DECLARE_INTERFACE (Extern, (Open,"xibbb")(Close,"")(KeepAlive,"uu")(Reconnect,"u")(Capture,"h")(Splice,"th")(SpliceTo,"h")(Flush,"")(Cork,"b"))
 public:
     using fd_t = PTimer::fd_t;
     enum class SocketSide : bool { Client, Server };
+    // Message bodies are compressed only when both sides offer it.
+    // By default, it is offered on network sockets, but not on UNIX
+    // sockets, where copying is cheaper than compressing.
+    enum class Compression : uint8_t { Auto, Off, On };
+    // Connections on UNIX sockets between processes supporting it
+    // transfer messages through shared memory rings, using the socket
+    // only for wakeups and fd passing. Socket disables this.
+    //
+    // UNIX sockets may also be SOCK_SEQPACKET, created by passing it as
+    // socktype to Connect or PExternServer::Bind. Each message is then
+    // sent as one packet, with its fds, and received with one recvmsg.
+    // Messages are limited to Extern::c_MaxPacketSize, and the shared
+    // memory ring is not used.
+    enum class Transport : uint8_t { Auto, Socket };
+    // When several Externs import an interface, relays created for it
+    // are assigned to one of them by the interface's balancing policy,
+    // set with Extern::SetBalance. First always uses the first Extern
+    // connected. RoundRobin rotates between them. LeastQueued picks the
+    // one with fewest messages waiting to be written, then with fewest
+    // relays. Hash keeps each local caller on the same Extern while the
+    // set of Externs is the same, and moves only callers of an Extern
+    // that is removed. With other than First, relays also fail over to
+    // another Extern when theirs is destroyed.
+    enum class Balance : uint8_t { First, RoundRobin, LeastQueued, Hash };
+    // Without keepalive, a peer that stops responding without closing
+    // its socket, as when its host goes down, is never noticed. With it,
+    // the link is pinged after intervalms without receiving anything,
+    // and closed when nothing arrives for timeoutms. The peer answers
+    // pings whether or not it has keepalive enabled, but older peers do
+    // not, and so are not pinged.
+    enum { DefaultKeepAliveMisses = 3 };
+    // A client connection with reconnect enabled is redialed to the same
+    // address when dropped, with exponential backoff. While disconnected,
+    // up to maxbuffered outgoing messages are queued, and relays created
+    // by local callers are kept; they create their remote objects anew
+    // when the queued messages arrive. Relays created by the peer are
+    // deleted, and ExternR::Connected is sent again after reconnecting.
+    // When the buffer fills up, or after Close, the Extern is destroyed.
+    enum { DefaultReconnectBuffer = 1024 };
+    // Capture writes each message received on the connection to a file,
+    // for replaying it later with test/extreplay. Messages are written
+    // as framed on the socket, but decompressed, each preceded by a
+    // CaptureRecord with the time since the previous one. Passed fds
+    // are not captured. Capture stops on Close, or when the file can
+    // not be written; an fd of -1 stops it explicitly.
+    struct CaptureRecord {
+	uint32_t	delay;	// in microseconds
+	uint32_t	size;	// of the message frame that follows
+    };
 public:
     explicit	PExtern (mrid_t caller)	: Proxy(caller) {}
+		PExtern (mrid_t caller, mrid_t dest)	: Proxy(caller,dest) {}
 		~PExtern (void)		{ FreeId(); }
+    void	Detach (void)		{ LinkW().dest = mrid_New; }
     void	Close (void)		{ Send (M_Close()); }
-    void	Open (fd_t fd, const iid_t* eifaces, SocketSide side = SocketSide::Server)
-		    { Send (M_Open(), eifaces, fd, side); }
-    void	Open (fd_t fd)		{ Open (fd, nullptr, SocketSide::Client); }
-    fd_t	Connect (const sockaddr* addr, socklen_t addrlen) noexcept;
+    void	Open (fd_t fd, const iid_t* eifaces, SocketSide side = SocketSide::Server, Compression c = Compression::Auto, Transport t = Transport::Auto)
+		    { Send (M_Open(), eifaces, fd, side, c, t); }
+    void	Open (fd_t fd, Compression c = Compression::Auto)
+		    { Open (fd, nullptr, SocketSide::Client, c); }
+    void	KeepAlive (uint32_t intervalms, uint32_t timeoutms = 0)
+		    { Send (M_KeepAlive(), intervalms, timeoutms ? timeoutms : intervalms*DefaultKeepAliveMisses); }
+    void	Reconnect (uint32_t maxbuffered = DefaultReconnectBuffer)
+		    { Send (M_Reconnect(), maxbuffered); }
+    void	Capture (fd_t fd) {
+		    auto& msg = CreateMsg (M_Capture(), stream_size_of(fd), 0);
+		    auto os = msg.Write();
+		    os << fd;
+		    CommitMsg (msg, os);
+		}
+    // Splice sends size bytes read from fd to the peer, after messages
+    // sent before it, and before those sent after. The data is moved
+    // between fd and the socket through a pipe, without copying it to
+    // user space. The peer writes it to the fd given to its SpliceTo,
+    // the same way, and then delivers the messages that follow. Those
+    // preceding it are delivered first, but pass through the message
+    // queue, and so may be handled after the data is written. With
+    // a connected fd on both sides, a proxy thus forwards bulk data
+    // between them without reading it. fd is closed when all is sent,
+    // and the connection is closed if it ends before size bytes.
+    // Splicing requires a stream socket transport, so a UNIX socket
+    // connection must be opened with Transport::Socket.
+    void	Splice (fd_t fd, uint64_t size) {
+		    auto& msg = CreateMsg (M_Splice(), variadic_stream_size (size, fd), stream_size_of(size));
+		    auto os = msg.Write();
+		    os << size << fd;
+		    CommitMsg (msg, os);
+		}
+    void	SpliceTo (fd_t fd) {
+		    auto& msg = CreateMsg (M_SpliceTo(), stream_size_of(fd), 0);
+		    auto os = msg.Write();
+		    os << fd;
+		    CommitMsg (msg, os);
+		}
+    // Messages sent after the first in a loop iteration are written
+    // together when it ends. Flush writes them sooner. Cork holds them
+    // until uncorked or flushed, also setting TCP_CORK on TCP sockets.
+    void	Flush (void)		{ Send (M_Flush()); }
+    void	Cork (bool corked = true) { Send (M_Cork(), corked); }
+    static fd_t	ConnectSocket (const sockaddr* addr, socklen_t addrlen, int socktype = SOCK_STREAM) noexcept;
+    fd_t	Connect (const sockaddr* addr, socklen_t addrlen, int socktype = SOCK_STREAM) noexcept;
     fd_t	ConnectIP4 (in_addr_t ip, in_port_t port) noexcept;
     fd_t	ConnectIP6 (in6_addr ip, in_port_t port) noexcept;
-    fd_t	ConnectLocal (const char* path) noexcept;
+    fd_t	ConnectLocal (const char* path, int socktype = SOCK_STREAM) noexcept;
     fd_t	ConnectLocalIP4 (in_port_t port) noexcept;
     fd_t	ConnectLocalIP6 (in_port_t port) noexcept;
     fd_t	ConnectSystemLocal (const char* sockname) noexcept;
     fd_t	ConnectUserLocal (const char* sockname) noexcept;
+    fd_t	ConnectBroker (void) noexcept;
     fd_t	LaunchPipe (const char* exe, const char* arg) noexcept;
     template <typename O>
     inline static bool Dispatch (O* o, const Msg& msg) noexcept {
@@ -71,9 +174,31 @@ public:
 	    auto eifaces = is.readv<const iid_t*>();
 	    auto fd = is.readv<fd_t>();
 	    auto side = is.readv<SocketSide>();
-	    o->Extern_Open (fd, eifaces, side);
+	    auto compression = is.readv<Compression>();
+	    auto transport = is.readv<Transport>();
+	    o->Extern_Open (fd, eifaces, side, compression, transport);
 	} else if (msg.Method() == M_Close())
 	    o->Extern_Close();
+	else if (msg.Method() == M_KeepAlive()) {
+	    auto is = msg.Read();
+	    auto intervalms = is.readv<uint32_t>();
+	    auto timeoutms = is.readv<uint32_t>();
+	    o->Extern_KeepAlive (intervalms, timeoutms);
+	} else if (msg.Method() == M_Reconnect())
+	    o->Extern_Reconnect (msg.Read().readv<uint32_t>());
+	else if (msg.Method() == M_Capture())
+	    o->Extern_Capture (msg.Read().readv<fd_t>());
+	else if (msg.Method() == M_Splice()) {
+	    auto is = msg.Read();
+	    auto size = is.readv<uint64_t>();
+	    auto fd = is.readv<fd_t>();
+	    o->Extern_Splice (fd, size);
+	} else if (msg.Method() == M_SpliceTo())
+	    o->Extern_SpliceTo (msg.Read().readv<fd_t>());
+	else if (msg.Method() == M_Flush())
+	    o->Extern_Flush();
+	else if (msg.Method() == M_Cork())
+	    o->Extern_Cork (msg.Read().readv<bool>());
 	else
 	    return false;
 	return true;
@@ -83,6 +208,23 @@ public:
 //}}}-------------------------------------------------------------------
 //{{{ ExternInfo
 
+// Traffic counters of an Extern connection. Messages are counted when
+// fully written or read. Queue times are measured from the time the
+// first message of a batch queued together is queued, until each is
+// fully written, in microseconds.
+struct ExternTraffic {
+    uint64_t		bytesIn;
+    uint64_t		bytesOut;
+    uint64_t		msgsIn;
+    uint64_t		msgsOut;
+    uint64_t		queueTime;	// total of all written messages
+    uint64_t		maxQueueTime;
+    uint32_t		writes;
+    uint32_t		partialWrites;	// ending in the middle of a message
+    uint32_t		writeWaits;	// on a full socket or ring
+    uint32_t		maxQueued;	// outgoing queue length high watermark
+};
+
 struct ExternInfo {
     using SocketSide = PExtern::SocketSide;
     vector<iid_t>	imported;
@@ -91,6 +233,10 @@ struct ExternInfo {
     mrid_t		oid;
     SocketSide		side;
     bool		isUnixSocket;
+    bool		isSeqPacket;
+    bool		isCompressed;
+    bool		isSharedMemory;
+    ExternTraffic	traffic;
 public:
     auto IsImporting (iid_t iid) const
 	{ return linear_search (imported, iid); }
@@ -135,9 +281,13 @@ public:
     inline void		COM_Error (const lstring& errmsg) noexcept;
     inline void		COM_Export (const lstring& elist) noexcept;
     inline void		COM_Delete (void) noexcept;
+    bool		OnExternDestroyed (void) noexcept;
+private:
+    bool		Failover (void) noexcept;
 private:
     Extern*	_pExtern;	// Outgoing connection object
     PCOM	_localp;	// Proxy to the local object
+    iid_t	_iface;		// Imported interface, for outgoing relays
     mrid_t	_extid;		// Extern link id
 };
 
@@ -145,8 +295,33 @@ private:
 //{{{ Extern
 
 class Extern : public Msger {
+    enum { f_OfferCompression = Msger::f_Last, f_OfferRing, f_Heard, f_PeerExtended, f_WakeupPending, f_FlushQueued, f_Corked, f_Flushing, f_Last };
 public:
     using fd_t = PExtern::fd_t;
+    // Messages smaller than this are received in bulk into a buffer,
+    // so a stream of them is read with one recvmsg per buffer-full.
+    enum : streamsize { c_RecvBufSize = 64*1024 };
+    // On SOCK_SEQPACKET sockets, each packet is received into the same
+    // buffer, so messages are limited to its size. PTransfer chunks fit,
+    // for larger objects. The kernel also limits packets to the socket
+    // send buffer size, by default larger than this.
+    enum : streamsize { c_MaxPacketSize = 2*c_RecvBufSize };
+    // Outgoing messages are written in batches of up to c_MaxIOVecs pieces.
+    // Pieces up to c_MaxStagedSize, such as headers and small bodies, are
+    // copied together into a staging buffer, written as one piece.
+    enum : unsigned { c_MaxIOVecs = min (IOV_MAX, 256) };
+    // Fds of all messages in a write are passed together in one
+    // SCM_RIGHTS array, limited by the kernel to SCM_MAX_FD fds.
+    enum : unsigned { c_MaxPassedFds = 253 };
+    enum : streamsize {
+	c_StagingSize = 16*1024,
+	c_MaxStagedSize = 512
+    };
+    // Reconnection delay doubles after each failed attempt
+    enum : uint32_t {
+	c_MinRedialDelay = 8,
+	c_MaxRedialDelay = 8*1024
+    };
 protected:
     enum {
 	// Each extern connection has two sides and each side must be able
@@ -171,26 +346,45 @@ public:
     explicit		Extern (const Msg::Link& l) noexcept;
 			~Extern (void) noexcept override;
     auto&		Info (void) const	{ return _einfo; }
+    unsigned		RelayCount (void) const	{ return _relays.size()-1; }	// without the COM link
+    template <typename F>
+    static void		ForEach (F f) noexcept	{ for (auto e : ExternTable()) if (e) f (*e); }
     bool		Dispatch (Msg& msg) noexcept override;
     void		QueueOutgoing (Msg&& msg) noexcept;
     static Extern*	LookupById (mrid_t id) noexcept;
-    static Extern*	LookupByImported (iid_t id) noexcept;
+    static Extern*	LookupByImported (iid_t id, mrid_t key = 0) noexcept;
     static Extern*	LookupByRelayId (mrid_t rid) noexcept;
-    mrid_t		RegisterRelay (const COMRelay* relay) noexcept;
+    static void		SetBalance (iid_t iid, PExtern::Balance b) noexcept;
+    // Access rules match peers by uid and primary gid, or AnyId. Only
+    // UNIX socket peers pass credentials, so network peers match none.
+    enum : uint32_t { AnyId = numeric_limits<uint32_t>::max() };
+    static void		Allow (iid_t iid, uid_t uid, gid_t gid = AnyId) noexcept;
+    static bool		CanFailover (iid_t iid) noexcept;
+    mrid_t		RegisterRelay (COMRelay* relay) noexcept;
     void		UnregisterRelay (const COMRelay* relay) noexcept;
-    inline void		Extern_Open (fd_t fd, const iid_t* eifaces, PExtern::SocketSide side) noexcept;
+    inline void		Extern_Open (fd_t fd, const iid_t* eifaces, PExtern::SocketSide side, PExtern::Compression compression, PExtern::Transport transport) noexcept;
     void		Extern_Close (void) noexcept;
+    void		Extern_KeepAlive (uint32_t intervalms, uint32_t timeoutms) noexcept;
+    void		Extern_Reconnect (uint32_t maxbuffered) noexcept;
+    void		Extern_Capture (fd_t fd) noexcept;
+    void		Extern_Splice (fd_t fd, uint64_t size) noexcept;
+    void		Extern_SpliceTo (fd_t fd) noexcept;
+    void		Extern_Flush (void) noexcept;
+    void		Extern_Cork (bool corked) noexcept;
     inline void		COM_Error (const lstring& errmsg) noexcept;
     inline void		COM_Export (string elist) noexcept;
     inline void		COM_Delete (void) noexcept;
     void		TimerR_Timer (fd_t fd) noexcept;
 private:
     //{{{2 ExtMsg ------------------------------------------------------
-    // Message formatted for reading/writing to socket
+    // Message formatted for reading/writing to socket. The header
+    // strings of outgoing messages are written from the interface
+    // block of the method, so only received messages store them.
     class ExtMsg {
     public:
 	struct alignas(8) Header {
-	    uint32_t	sz;		// Message body size, aligned to c_MsgAlignment
+	    uint32_t	sz:24;		// Message body size, aligned to c_MsgAlignment
+	    uint32_t	flags:8;	// Body encoding, see hf_ flags below
 	    uint16_t	extid;		// Destination node mrid
 	    uint8_t	fdoffset;	// Offset to file descriptor in message body, if passing
 	    uint8_t	hsz;		// Full size of header
@@ -198,73 +392,320 @@ private:
 	enum {
 	    c_MinHeaderSize = Align (sizeof(Header)+sizeof("i\0m\0"), Msg::Alignment::Header),
 	    c_MaxHeaderSize = UINT8_MAX-sizeof(Header),
-	    c_MaxBodySize = (1<<24)-1
+	    c_MaxBodySize = (1<<24)-1,
+	    c_MinCompressSize = 256,	// smaller bodies are not worth compressing
+	    c_FixedIOVecs = 7		// header pieces, body, and padding
 	};
+	// An fd array has its element count before fdoffset.
+	// A request or its reply has the request id after the fixed header.
+	// Priority other than Normal is flagged, for the receiver to queue.
+	enum { hf_Compressed, hf_FdArray, hf_RequestId, hf_LowPriority, hf_HighPriority, hf_Last };
     public:
-			ExtMsg (void)		: _body(),_h{},_hbuf{} {}
+			ExtMsg (void)		: _body(),_chain(),_h{},_reqid(),_method(),_queued(),_hstr() {}
 	inline		ExtMsg (Msg&& msg) noexcept;
 	streamsize	HeaderSize (void) const	{ return _h.hsz; }
 	auto&		GetHeader (void) const	{ return _h; }
 	streamsize	BodySize (void) const	{ return _h.sz; }
 	auto		Extid (void) const	{ return _h.extid; }
 	auto		FdOffset (void) const	{ return _h.fdoffset; }
+	auto		Method (void) const	{ return _method; }
+	auto		QueuedAt (void) const	{ return _queued; }
+	void		SetQueuedAt (uint64_t t)	{ _queued = t; }
+	auto&		HeaderStrings (void) const	{ return _hstr; }
+	bool		IsCompressed (void) const	{ return GetBit (_h.flags, hf_Compressed); }
 	streamsize	Size (void) const	{ return BodySize() + HeaderSize(); }
 	bool		HasFd (void) const	{ return FdOffset() != Msg::NoFdIncluded; }
-	void		SetHeader (const Header& h)	{ _h = h; }
-	void		ResizeBody (streamsize sz)	{ _body.resize (sz); }
+	bool		HasRequestId (void) const	{ return GetBit (_h.flags, hf_RequestId); }
+	auto		GetPriority (void) const {
+			    return GetBit (_h.flags, hf_HighPriority) ? Msg::Priority::High
+				: GetBit (_h.flags, hf_LowPriority) ? Msg::Priority::Low
+				: Msg::Priority::Normal;
+			}
+	Msg::reqid_t	RequestId (void) const noexcept;
+	void		SetHeader (const Header& h)	{ _h = h; _body.clear(); _hstr.clear(); }
+	void		AllocateBody (void)		{ _hstr.resize (HeaderSize()-sizeof(_h)); _body.resize (BodySize()); }
 	void		TrimBody (streamsize sz)	{ _body.memlink::resize (sz); }
 	auto&&		MoveBody (void)			{ return move(_body); }
-	void		SetPassedFd (fd_t fd)	{ assert (HasFd()); ostream os (_body.iat(_h.fdoffset), sizeof(fd)); os << fd; }
-	fd_t		PassedFd (void) const noexcept;
-	void		WriteIOVecs (iovec* iov, streamsize bw) noexcept;
+	bool		HasFdArray (void) const	{ return GetBit (_h.flags, hf_FdArray); }
+	unsigned	FdCount (void) const noexcept;
+	unsigned	UnsentFdCount (void) const	{ return PassedFd() >= 0 ? FdCount() : 0; }
+	void		SetPassedFd (unsigned i, fd_t fd)	{ assert (i < FdCount()); ostream os (_body.iat(_h.fdoffset+i*sizeof(fd)), sizeof(fd)); os << fd; }
+	fd_t		PassedFd (unsigned i = 0) const noexcept;
+	streamsize	SegmentsSize (void) const noexcept;
+	auto&		Segments (void) const	{ return _chain ? _chain->segs : Msg::c_NoSegments; }
+	bool		IsContiguous (void) const	{ return Segments().empty() && _body.size() == BodySize(); }
+	unsigned	IOVecCount (void) const	{ return c_FixedIOVecs + Segments().size(); }
+	// Size and iovec count of msg when exported uncompressed
+	static streamsize ExportSize (const Msg& msg) noexcept
+			    { return HeaderSizeFor (msg.Method(), msg.RequestId() != Msg::NoRequest) + Align (msg.Size(), Msg::Alignment::Body); }
+	static unsigned	ExportIOVecCount (const Msg& msg)	{ return c_FixedIOVecs + msg.Segments().size(); }
+	unsigned	WriteIOVecs (iovec* iov, streamsize bw, unsigned maxiov = UINT_MAX) noexcept;
+	void		ReadIOVecs (iovec* iov, streamsize br) noexcept;
 	auto		Read (void) const	{ return istream (_body.data(), _body.size()); }
 	methodid_t	ParseMethod (void) const noexcept;
+	void		Compress (void) noexcept;
+	bool		Decompress (void) noexcept;
 	inline void	DebugDump (void) const noexcept;
     private:
-	auto		HeaderPtr (void) const	{ auto hp = _hbuf; return hp-sizeof(_h); }
-	auto		HeaderPtr (void)	{ return UNCONST_MEMBER_FN (HeaderPtr,); }
-	uint8_t		WriteHeaderStrings (methodid_t method) noexcept;
+	static uint8_t	HeaderSizeFor (methodid_t method, bool hasreqid) noexcept;
     private:
 	Msg::Body	_body;
+	Msg::chainptr_t	_chain;
 	Header		_h;
-	char		_hbuf [c_MaxHeaderSize];
+	Msg::reqid_t	_reqid;		// of outgoing messages
+	methodid_t	_method;	// of outgoing messages
+	uint64_t	_queued;	// time queued, in microseconds
+	memblock	_hstr;		// header strings of received messages
+    };
+    //}}}2--------------------------------------------------------------
+public:
+    // Frames on the socket, and in captures, begin with this header,
+    // followed by the request id, if flagged, and the header strings.
+    // Messages to extid c_FrameExtidCOM are for the link itself.
+    using FrameHeader = ExtMsg::Header;
+    enum : uint8_t { c_FrameRequestIdFlag = BitMask<uint8_t> (ExtMsg::hf_RequestId) };
+    enum : mrid_t { c_FrameExtidCOM = extid_COM };
+private:
+    //{{{2 OutQueue ----------------------------------------------------
+    // Queue of outgoing messages. Written messages are released at
+    // once, but removed from the vector only when they outnumber the
+    // queued ones, so that each message is moved a constant number
+    // of times, rather than on every write.
+    class OutQueue {
+    public:
+	using size_type = vector<ExtMsg>::size_type;
+    public:
+			OutQueue (void)		: _q(),_f() {}
+	bool		empty (void) const	{ return _f == _q.size(); }
+	size_type	size (void) const	{ return _q.size()-_f; }
+	auto&		operator[] (size_type i)	{ return _q[_f+i]; }
+	auto&		front (void)		{ return _q[_f]; }
+	ExtMsg&		emplace_back (Msg&& msg, size_type minpos = 0) noexcept;
+	void		pop_front (size_type n) noexcept;
+	ExtMsg&		emplace_front (Msg&& msg) noexcept;
+	template <typename Discriminator>
+	void		remove_if (Discriminator f) {
+			    _q.erase (_q.begin(), exchange (_f, 0));
+			    cwiclo::remove_if (_q, f);
+			}
+    private:
+	vector<ExtMsg>	_q;
+	size_type	_f;		// first queued message in _q
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 ShmRing -----------------------------------------------------
+    // Single producer, single consumer byte ring in a shared memfd.
+    // Each side of a connection writes its own ring and reads the
+    // other's, replacing the socket byte stream. Positions are free
+    // running counters; the ring contents and the reader's position
+    // can be modified by the other process, and so are validated.
+    class ShmRing {
+    public:
+	enum : uint32_t { c_Capacity = 256*1024 };
+	struct Header {
+	    alignas(64) uint32_t tail;	// written by the writer
+	    uint32_t	readerWaiting;	// set by the reader before sleeping
+	    alignas(64) uint32_t head;	// written by the reader
+	    uint32_t	writerWaiting;	// set by the writer when full
+	};
+	enum : streamsize { c_MapSize = sizeof(Header) + c_Capacity };
+    public:
+			ShmRing (void)		: _h() {}
+			~ShmRing (void) noexcept	{ Close(); }
+			ShmRing (const ShmRing&) = delete;
+	void		operator= (const ShmRing&) = delete;
+	bool		IsOpen (void) const	{ return _h; }
+	fd_t		Create (void) noexcept;
+	bool		Attach (fd_t fd) noexcept;
+	void		Close (void) noexcept;
+	ssize_t		Write (const iovec* iov, unsigned niov) noexcept;
+	ssize_t		Read (const iovec* iov, unsigned niov) noexcept;
+	bool		WaitForWriter (void) noexcept;
+	bool		WaitForReader (void) noexcept;
+	bool		ReaderWaiting (void) noexcept	{ return Woken (_h->readerWaiting); }
+	bool		WriterWaiting (void) noexcept	{ return Woken (_h->writerWaiting); }
+    private:
+	bool		Map (fd_t fd) noexcept;
+	auto		Data (void)		{ return reinterpret_cast<char*>(_h+1); }
+	uint32_t	Used (void) const	{ return __atomic_load_n (&_h->tail, __ATOMIC_ACQUIRE) - __atomic_load_n (&_h->head, __ATOMIC_ACQUIRE); }
+	static bool	Woken (uint32_t& f) noexcept;
+    private:
+	Header*		_h;
+    };
+    //}}}2--------------------------------------------------------------
+    //{{{2 SpliceStream ------------------------------------------------
+    // Data spliced between a local fd and the socket, through a pipe,
+    // since splice requires one on either side. When the local fd is
+    // not ready, it is watched with the stream's own timer, and the
+    // Extern is notified as for the socket.
+    class SpliceStream {
+    public:
+	enum class Status : uint8_t { Done, WaitSocket, WaitLocal, Ended, Failed };
+	enum : streamsize { c_PipeSize = 1024*1024 };	// if allowed, else the default
+    public:
+	explicit	SpliceStream (mrid_t owner)	: _timer (owner),_pipe{-1,-1},_fd(-1),_pipesz(),_inpipe(),_left(),_blocked() {}
+			~SpliceStream (void) noexcept	{ ClosePipe(); }
+			SpliceStream (const SpliceStream&) = delete;
+	void		operator= (const SpliceStream&) = delete;
+	auto		Fd (void) const		{ return _fd; }
+	auto		Left (void) const	{ return _left; }
+	bool		IsActive (void) const	{ return _left; }
+	bool		IsBlocked (void) const	{ return _blocked; }
+	fd_t		SetFd (fd_t fd) noexcept;
+	void		Start (uint64_t size)	{ _left = size; }
+	void		Finish (void) noexcept;
+	void		Ready (fd_t fd)		{ if (fd == _fd) _blocked = false; }
+	Status		Transfer (fd_t from, fd_t to) noexcept;
+	Status		Write (const char* p, streamsize n, streamsize& nw) noexcept;
+    private:
+	bool		OpenPipe (void) noexcept;
+	void		ClosePipe (void) noexcept;
+	Status		Wait (fd_t fd, PTimer::WatchCmd cmd) noexcept;
+    private:
+	PTimer		_timer;
+	fd_t		_pipe[2];
+	fd_t		_fd;
+	uint32_t	_pipesz;
+	uint32_t	_inpipe;	// bytes in the pipe, not yet written out
+	uint64_t	_left;		// bytes not yet written out
+	bool		_blocked;	// waiting for _fd
+    };
+    struct SpliceSource {
+	fd_t		fd;
+	uint64_t	size;
     };
     //}}}2--------------------------------------------------------------
     //{{{2 RelayProxy
     struct RelayProxy {
-	const COMRelay*	pRelay;
+	COMRelay*	pRelay;
 	PCOM		relay;
+	iid_t		iid;	// granted to the peer, null for local callers
 	mrid_t		extid;
     public:
-	RelayProxy (mrid_t src, mrid_t dest, mrid_t eid)
-	    : pRelay(), relay(src,dest), extid(eid) {}
+	RelayProxy (mrid_t src, mrid_t dest, mrid_t eid, iid_t i = nullptr)
+	    : pRelay(), relay(src,dest), iid(i), extid(eid) {}
 	RelayProxy (const RelayProxy&) = delete;
 	void operator= (const RelayProxy&) = delete;
     };
     //}}}2--------------------------------------------------------------
+private:
+    // Capability token appended to the COM Export list. It is not a
+    // valid interface name, so peers not supporting it ignore it.
+    static constexpr const char c_CompressionToken[] = "@lz";
+    static constexpr const char c_RingToken[] = "@shm";
+    // Offered by peers accepting COM::Ping, request ids, fd arrays,
+    // and priorities
+    static constexpr const char c_ExtendedToken[] = "@ext";
 private:
     mrid_t		CreateExtidFromRelayId (mrid_t id) const noexcept
 			    { return id + ((_einfo.side == ExternInfo::SocketSide::Client) ? extid_ClientBase : extid_ServerBase); }
-    static auto&	ExternList (void) noexcept
-			    { static vector<Extern*> s_ExternList; return s_ExternList; }
+    // Both sides allocate extids up from their base, so the two ranges
+    // are interleaved in _relayByExtid to keep it dense.
+    static constexpr mrid_t ExtidSlot (mrid_t extid) noexcept
+			    { return extid < extid_ServerBase ? 2*(extid-extid_ClientBase) : 2*(extid-extid_ServerBase)+1; }
+    // Externs, relays, and imported interfaces are indexed for O(1)
+    // lookup when routing messages. Externs are indexed by Msger id.
+    // RelayTable maps relay Msger ids to the Extern and the position in
+    // its _relays, and each Extern maps extids in _relayByExtid.
+    // ImportTable has the Externs importing each interface, in the
+    // order connected, and the balancing policy of the interface.
+    // AccessTable has the rules for exported interfaces, checked only
+    // when creating a relay for the peer, which then keeps the iid.
+    struct RelayLoc {
+	Extern*		pExtern;
+	mrid_t		pos;
+    };
+    struct ImportLoc {
+	iid_t		iid;
+	PExtern::Balance balance;
+	uint32_t	next;	// round robin position
+	vector<Extern*>	externs;
+    };
+    struct AccessRule {
+	iid_t		iid;
+	uid_t		uid;
+	gid_t		gid;
+    };
+    enum : mrid_t { c_NoRelay = numeric_limits<mrid_t>::max() };
+    static auto&	ExternTable (void) noexcept
+			    { static vector<Extern*> s_ExternTable; return s_ExternTable; }
+    static auto&	RelayTable (void) noexcept
+			    { static vector<RelayLoc> s_RelayTable; return s_RelayTable; }
+    static auto&	ImportTable (void) noexcept
+			    { static vector<ImportLoc> s_ImportTable; return s_ImportTable; }
+    static auto&	AccessTable (void) noexcept
+			    { static vector<AccessRule> s_AccessTable; return s_AccessTable; }
+    static RelayLoc*	LookupRelayLoc (mrid_t id) noexcept;
+    static ImportLoc*	LookupImportLoc (iid_t iid) noexcept;
+    bool		IsAccessible (iid_t iid) const noexcept;
     RelayProxy*		RelayProxyByExtid (mrid_t extid) noexcept;
     RelayProxy*		RelayProxyById (mrid_t id) noexcept;
+    void		IndexRelay (mrid_t pos) noexcept;
+    void		IndexImports (void) noexcept;
+    void		UnindexImports (void) noexcept;
+    Msg			ExportMsg (void) const noexcept;
+    void		Disconnect (void) noexcept;
+    void		Redial (void) noexcept;
+    unsigned		CollectOutgoing (iovec* iov, unsigned maxnm, unsigned& nm, bool stage, fd_t* fds, unsigned& nfds) noexcept;
+    void		CloseSentFds (unsigned nm) noexcept;
+    unsigned		StageIOVecs (iovec* iov, unsigned first, unsigned last) noexcept;
+    unsigned		EraseWritten (unsigned nm) noexcept;
+    inline ExtMsg&	Enqueue (Msg&& msg) noexcept;
+    PTimer::mstime_t	KeepAliveTimeout (void) noexcept;
     bool		WriteOutgoing (void) noexcept;
+    bool		WriteOutgoingRing (void) noexcept;
+    bool		WriteSplice (void) noexcept;
     void		ReadIncoming (void) noexcept;
+    void		ReadIncomingPackets (void) noexcept;
+    bool		ValidIncomingHeader (void) const noexcept;
+    bool		DeliverIncoming (void) noexcept;
+    void		CaptureIncoming (void) noexcept;
+    bool		ReadSplice (void) noexcept;
+    bool		SpliceFailed (void) noexcept;
+    void		CancelSplices (void) noexcept;
+    inline bool		AcceptStream (void) noexcept;
+    bool		ReadWakeups (unsigned minfds = 1) noexcept;
+    bool		ReceiveAncillary (msghdr& mh) noexcept;
+    bool		SendWakeup (const fd_t* fds = nullptr, unsigned nfds = 0) noexcept;
+    void		OpenRing (void) noexcept;
+    inline bool		AttachRing (void) noexcept;
     inline bool		AcceptIncomingMessage (void) noexcept;
     inline bool		AttachToSocket (fd_t fd) noexcept;
     void		EnableCredentialsPassing (bool enable) noexcept;
+    void		SetTcpCork (bool corked) noexcept;
 private:
     fd_t		_sockfd;
     PTimer		_timer;
+    PExtern		_self;		// to queue Flush after the current messages
     PExternR		_reply;
     streamsize		_bwritten;
-    vector<ExtMsg>	_outq;		// messages queued for export
+    OutQueue		_outq;		// messages queued for export
+    memblock		_wbuf;		// staging buffer for small pieces
     vector<RelayProxy>	_relays;
+    vector<mrid_t>	_relayByExtid;	// ExtidSlot -> position in _relays
     ExternInfo		_einfo;
     streamsize		_bread;
     ExtMsg		_inmsg;		// currently incoming message
-    fd_t		_infd;
+    vector<fd_t>	_infds;		// received fds, for incoming messages in order
+    memblock		_rbuf;		// bulk receive buffer
+    streamsize		_rbufp;		// parsed offset in _rbuf
+    ShmRing		_txring;
+    ShmRing		_rxring;
+    uint32_t		_nsockmsgs;	// messages to write on the socket before _txring
+    uint32_t		_pinginterval;	// keepalive, 0 when disabled
+    uint32_t		_deadtimeout;
+    PTimer::mstime_t	_lastheard;	// when anything was last received
+    PTimer::mstime_t	_lastping;
+    uint32_t		_maxbuffered;	// while reconnecting
+    uint32_t		_redialdelay;
+    socklen_t		_peeraddrlen;	// nonzero when reconnecting
+    sockaddr_storage	_peeraddr;
+    fd_t		_capfd;		// capture file, when capturing
+    uint64_t		_lastcap;	// when the last message was captured
+    uint64_t		_batchtime;	// when the outgoing batch was started
+    SpliceStream	_spliceout;	// data being sent
+    SpliceStream	_splicein;	// data being received, to the SpliceTo fd
+    vector<SpliceSource> _splicesrc;	// data to send after queued stream messages
 };
 
 #define REGISTER_EXTERNS\
@@ -283,20 +724,25 @@ class PExternServer : public Proxy {
 public:
     using fd_t = PExtern::fd_t;
     enum class WhenEmpty : bool { Remain, Close };
+    // With ReusePort::On, several processes can each bind a listener
+    // to the same IP port, and the kernel distributes connections
+    // between them. All of them must enable it.
+    enum class ReusePort : bool { Off, On };
 public:
     explicit	PExternServer (mrid_t caller)	: Proxy(caller),_sockname() {}
 		~PExternServer (void) noexcept;
     void	Close (void)			{ Send (M_Close()); }
     void	Open (fd_t fd, const iid_t* eifaces, WhenEmpty closeWhenEmpty = WhenEmpty::Close)
 		    { Send (M_Open(), eifaces, fd, closeWhenEmpty); }
-    fd_t	Bind (const sockaddr* addr, socklen_t addrlen, const iid_t* eifaces) noexcept NONNULL();
-    fd_t	BindLocal (const char* path, const iid_t* eifaces) noexcept NONNULL();
+    fd_t	Bind (const sockaddr* addr, socklen_t addrlen, const iid_t* eifaces, ReusePort reuse = ReusePort::Off, int socktype = SOCK_STREAM) noexcept NONNULL();
+    fd_t	BindLocal (const char* path, const iid_t* eifaces, int socktype = SOCK_STREAM) noexcept NONNULL();
     fd_t	BindUserLocal (const char* sockname, const iid_t* eifaces) noexcept NONNULL();
+    fd_t	BindBroker (const iid_t* eifaces) noexcept NONNULL();
     fd_t	BindSystemLocal (const char* sockname, const iid_t* eifaces) noexcept NONNULL();
-    fd_t	BindIP4 (in_addr_t ip, in_port_t port, const iid_t* eifaces) noexcept NONNULL();
-    fd_t	BindLocalIP4 (in_port_t port, const iid_t* eifaces) noexcept NONNULL();
-    fd_t	BindIP6 (in6_addr ip, in_port_t port, const iid_t* eifaces) noexcept NONNULL();
-    fd_t	BindLocalIP6 (in_port_t port, const iid_t* eifaces) noexcept NONNULL();
+    fd_t	BindIP4 (in_addr_t ip, in_port_t port, const iid_t* eifaces, ReusePort reuse = ReusePort::Off) noexcept NONNULL();
+    fd_t	BindLocalIP4 (in_port_t port, const iid_t* eifaces, ReusePort reuse = ReusePort::Off) noexcept NONNULL();
+    fd_t	BindIP6 (in6_addr ip, in_port_t port, const iid_t* eifaces, ReusePort reuse = ReusePort::Off) noexcept NONNULL();
+    fd_t	BindLocalIP6 (in_port_t port, const iid_t* eifaces, ReusePort reuse = ReusePort::Off) noexcept NONNULL();
     template <typename O>
     inline static bool Dispatch (O* o, const Msg& msg) noexcept {
 	if (msg.Method() == M_Open()) {
@@ -322,6 +768,9 @@ class ExternServer : public Msger {
     enum { f_CloseWhenEmpty = Msger::f_Last, f_Last };
 public:
     using fd_t = PExternServer::fd_t;
+    // Accepting stops after this many connections, to let the accepted
+    // Externs start their handshakes during a connection storm.
+    enum : unsigned { c_MaxAcceptBatch = 64 };
 public:
     explicit		ExternServer (const Msg::Link& l) noexcept;
     bool		OnError (mrid_t eid, const string& errmsg) noexcept override;
@@ -339,5 +788,337 @@ private:
     fd_t		_sockfd;
 };
 
+//}}}-------------------------------------------------------------------
+//{{{ PExternPool
+
+// Keeps warm server processes, launched as by PExtern::LaunchPipe,
+// and hands out their connected pipes on request. Launching is then
+// only the time to open an Extern on the pipe, since the server is
+// already running and has sent its handshake. Each handed out process
+// is replaced, and warm processes that exit are restarted.
+//
+// exe and arg are not copied, and must remain valid while the pool is.
+//
+class PExternPool : public Proxy {
+    DECLARE_INTERFACE (ExternPool, (Open,"xxu")(Launch,""))
+public:
+    using fd_t = PExtern::fd_t;
+    enum : uint32_t { c_DefaultWarm = 2 };
+public:
+    explicit	PExternPool (mrid_t caller)	: Proxy(caller) {}
+		~PExternPool (void)		{ FreeId(); }
+    void	Open (const char* exe, const char* arg, uint32_t nwarm = c_DefaultWarm)
+		    { Send (M_Open(), exe, arg, nwarm); }
+    void	Launch (void)			{ Send (M_Launch()); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() == M_Open()) {
+	    auto is = msg.Read();
+	    auto exe = is.readv<const char*>();
+	    auto arg = is.readv<const char*>();
+	    auto nwarm = is.readv<uint32_t>();
+	    o->ExternPool_Open (exe, arg, nwarm);
+	} else if (msg.Method() == M_Launch())
+	    o->ExternPool_Launch();
+	else
+	    return false;
+	return true;
+    }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ PExternPoolR
+
+// Replies to Launch with the client side of the server pipe,
+// to be opened with PExtern::Open by the recipient.
+class PExternPoolR : public ProxyR {
+    DECLARE_INTERFACE (ExternPoolR, (Launched,"h"))
+public:
+    using fd_t = PExternPool::fd_t;
+public:
+    explicit	PExternPoolR (const Msg::Link& l)	: ProxyR(l) {}
+    void	Launched (fd_t fd) {
+		    auto& msg = CreateMsg (M_Launched(), stream_size_of(fd), 0);
+		    auto os = msg.Write();
+		    os << fd;
+		    CommitMsg (msg, os);
+		}
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Launched())
+	    return false;
+	o->ExternPoolR_Launched (msg.Read().readv<fd_t>());
+	return true;
+    }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ ExternPool
+
+class ExternPool : public Msger {
+public:
+    using fd_t = PExternPool::fd_t;
+    // Restarting stops when warm processes keep exiting
+    enum : unsigned { c_MaxRestarts = 8 };
+public:
+    explicit		ExternPool (const Msg::Link& l) noexcept;
+			~ExternPool (void) noexcept override;
+    bool		Dispatch (Msg& msg) noexcept override;
+    inline void		ExternPool_Open (const char* exe, const char* arg, uint32_t nwarm) noexcept;
+    inline void		ExternPool_Launch (void) noexcept;
+    inline void		Signal_Signal (int sig) noexcept;
+private:
+    struct Pipe {
+	pid_t	pid;
+	fd_t	fd;
+    };
+private:
+    bool		Replenish (uint32_t nwarm) noexcept;
+private:
+    vector<Pipe>	_warm;
+    vector<pid_t>	_launched;	// reaped when they exit
+    PExternPoolR	_reply;
+    const char*		_exe;
+    const char*		_arg;
+    string		_exepath;
+    uint32_t		_nwarm;
+    uint32_t		_nrestarts;
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ PExternBroker
+
+// A broker lets clients find servers by interface, instead of by socket
+// name. The broker daemon listens on the well-known c_SocketName, bound
+// with PExternServer::BindBroker, and exports ExternBroker. Servers
+// connect to it with PExtern::ConnectBroker and Register the interfaces
+// they serve on their listening socket. A client connected to the
+// broker can then use the broker's connection in two ways:
+//
+// 1. Multiplexed. Interfaces exported by the broker daemon in addition
+//    to ExternBroker are relayed to registered servers, so one client
+//    connection reaches all of them, at the cost of a relay hop in the
+//    broker. The daemon must be built with them registered as
+//    REGISTER_EXTERN_MSGER, along with their reply interfaces.
+// 2. Direct. Connect asks the broker to connect to the server of the
+//    interface, and replies with the connected socket, to be opened
+//    with PExtern::Open. Calls on it then go to the server directly.
+//    Credentials seen by the server are those of the broker.
+//
+// Connect waits for the interface to be registered, so clients can be
+// started before servers. Registrations are removed when the server's
+// connection to the broker is closed.
+//
+class PExternBroker : public Proxy {
+    DECLARE_INTERFACE (ExternBroker, (Register,"hs")(Connect,"s"))
+public:
+    using fd_t = PExtern::fd_t;
+    static constexpr const char c_SocketName[] = "cwiclo.broker";
+public:
+    explicit	PExternBroker (mrid_t caller)	: Proxy(caller) {}
+		~PExternBroker (void)		{ FreeId(); }
+    void	Open (void)	{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    // The listening socket fd is sent to the broker and closed here,
+    // so a server still listening on it must pass a dup.
+    void	Register (fd_t sfd, const iid_t* eifaces) noexcept;
+    void	Connect (iid_t iface)	{ Send (M_Connect(), lstring (iface)); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() == M_Register()) {
+	    auto is = msg.Read();
+	    auto sfd = is.readv<fd_t>();
+	    o->ExternBroker_Register (sfd, lstring_from_stream (is));
+	} else if (msg.Method() == M_Connect())
+	    o->ExternBroker_Connect (lstring_from_const_stream (msg.Read()));
+	else
+	    return false;
+	return true;
+    }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ PExternBrokerR
+
+class PExternBrokerR : public ProxyR {
+    DECLARE_INTERFACE (ExternBrokerR, (Connection,"hs"))
+public:
+    using fd_t = PExternBroker::fd_t;
+public:
+    explicit	PExternBrokerR (const Msg::Link& l)	: ProxyR(l) {}
+    void	Connection (fd_t fd, const lstring& iname) noexcept;
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Connection())
+	    return false;
+	auto is = msg.Read();
+	auto fd = is.readv<fd_t>();
+	auto iname = lstring_from_stream (is);
+	o->ExternBrokerR_Connection (fd, App::InterfaceByName (iname.c_str(), iname.size()+1));
+	return true;
+    }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ ExternBroker
+
+// Created for each relay to the broker, so the registry is shared
+class ExternBroker : public Msger {
+public:
+    using fd_t = PExternBroker::fd_t;
+public:
+    explicit		ExternBroker (const Msg::Link& l) noexcept;
+			~ExternBroker (void) noexcept override;
+    bool		Dispatch (Msg& msg) noexcept override;
+    void		OnMsgerDestroyed (mrid_t mid) noexcept override;
+    inline void		ExternBroker_Register (fd_t sfd, const lstring& elist) noexcept;
+    inline void		ExternBroker_Connect (const lstring& iname) noexcept;
+    inline void		ExternR_Connected (const ExternInfo* einfo) noexcept;
+private:
+    struct Service {
+	string		iname;
+	ExternBroker*	server;	// the broker the server registered with
+    };
+    static auto&	BrokerTable (void) noexcept
+			    { static vector<ExternBroker*> s_BrokerTable; return s_BrokerTable; }
+    static auto&	ServiceTable (void) noexcept
+			    { static vector<Service> s_ServiceTable; return s_ServiceTable; }
+    static Service*	LookupService (const lstring& iname) noexcept;
+    void		Publish (void) noexcept;
+    void		Unpublish (void) noexcept;
+    bool		Handoff (const lstring& iname) noexcept;
+private:
+    PExternBrokerR	_reply;
+    PExtern		_relayed;	// broker's connection to the server, for multiplexed calls
+    vector<string>	_registered;	// published when _relayed is connected
+    vector<string>	_waiting;	// Connect requests waiting for a server
+    socklen_t		_addrlen;
+    int			_socktype;	// of the server's listening socket
+    sockaddr_storage	_addr;		// of the registered server
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ PExternStats
+
+// Queries traffic statistics of all Extern connections in a process.
+// Register ExternStats to serve it, locally or on an exported socket,
+// to be dumped from a live process with test/extstat.
+//
+class PExternStats : public Proxy {
+    DECLARE_INTERFACE (ExternStats, (Query,""))
+public:
+    explicit	PExternStats (mrid_t caller)	: Proxy(caller) {}
+		~PExternStats (void)		{ FreeId(); }
+    void	Open (void)	{ CreateDestWith (Interface(), &Msger::Factory<COMRelay>); }
+    void	Query (void)	{ Send (M_Query()); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Query())
+	    return false;
+	o->ExternStats_Query();
+	return true;
+    }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ PExternStatsR
+
+class PExternStatsR : public ProxyR {
+    DECLARE_INTERFACE (ExternStatsR, (Stats,"a(qqi(ttttttuuuu))"))
+public:
+    struct Connection {
+	mrid_t		id;		// of the Extern
+	uint16_t	nrelays;
+	int32_t		peerpid;
+	ExternTraffic	traffic;
+    };
+    using connections_t = vector<Connection>;
+public:
+    explicit	PExternStatsR (const Msg::Link& l)	: ProxyR(l) {}
+    void	Stats (const connections_t& c)	{ Send (M_Stats(), c); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Stats())
+	    return false;
+	o->ExternStatsR_Stats (msg.Read().readv<connections_t>());
+	return true;
+    }
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ ExternStats
+
+class ExternStats : public Msger {
+public:
+    explicit		ExternStats (const Msg::Link& l) noexcept : Msger(l),_reply(l) {}
+    bool		Dispatch (Msg& msg) noexcept override;
+    inline void		ExternStats_Query (void) noexcept;
+private:
+    PExternStatsR	_reply;
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ PTransfer
+
+// Streams objects too large for one message, as a sequence of Data
+// chunks. The receiver processes each chunk as it arrives and then
+// acknowledges it, opening the sender's window for more. Memory used
+// by a transfer in flight is thus bounded by c_Window on both sides,
+// regardless of object size, and ExtMsg body size limit does not apply.
+//
+class PTransfer : public Proxy {
+    DECLARE_INTERFACE (Transfer, (Open,"t")(Data,"ay")(Close,""))
+public:
+    enum : streamsize {
+	c_ChunkSize = 64*1024,
+	c_Window = 4*c_ChunkSize
+    };
+public:
+    explicit	PTransfer (mrid_t caller)	: Proxy(caller),_sent(),_acked() {}
+		~PTransfer (void)		{ FreeId(); }
+    auto	Sent (void) const		{ return _sent; }
+    streamsize	Window (void) const		{ return c_Window - (_sent - _acked); }
+    bool	AllAcknowledged (void) const	{ return _sent == _acked; }
+    void	Open (uint64_t sz)		{ _sent = _acked = 0; Send (M_Open(), sz); }
+    void	Close (void)			{ Send (M_Close()); }
+    void	Data (const cmemlink& chunk) noexcept;
+    streamsize	Write (const cmemlink& data) noexcept;
+    void	Acknowledged (uint32_t sz)	{ assert (sz <= _sent-_acked); _acked += sz; }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() == M_Open())
+	    o->Transfer_Open (msg.Read().readv<uint64_t>());
+	else if (msg.Method() == M_Data()) {
+	    auto is = msg.Read();
+	    cmemlink chunk;
+	    chunk.link_read (is);
+	    o->Transfer_Data (chunk);
+	} else if (msg.Method() == M_Close())
+	    o->Transfer_Close();
+	else
+	    return false;
+	return true;
+    }
+private:
+    uint64_t	_sent;
+    uint64_t	_acked;
+};
+
+//}}}-------------------------------------------------------------------
+//{{{ PTransferR
+
+class PTransferR : public ProxyR {
+    DECLARE_INTERFACE (TransferR, (Ack,"u"))
+public:
+    explicit	PTransferR (const Msg::Link& l)	: ProxyR(l) {}
+    void	Ack (uint32_t sz)		{ Send (M_Ack(), sz); }
+    template <typename O>
+    inline static bool Dispatch (O* o, const Msg& msg) noexcept {
+	if (msg.Method() != M_Ack())
+	    return false;
+	o->TransferR_Ack (msg.Read().readv<uint32_t>());
+	return true;
+    }
+};
+
 } // namespace cwiclo
 //}}}-------------------------------------------------------------------